@@ -0,0 +1,1310 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+/*
+ * the benchmark drives the static kernels and file coders of lzpi directly,
+ * so it takes in all of lzpi with its main and usage renamed
+ */
+#define main lzpi_main
+#define usage lzpi_usage
+#include "lzpi.c"
+#undef usage
+#undef main
+
+#include <getopt.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * hardware events counted around each kernel
+ */
+enum { EV_CYC, EV_INS, EV_BRM, EV_L1D, EV_LLC, EV_CNT };
+
+/*
+ * a measurement of one kernel run, where an event count is negative if the
+ * event is unavailable
+ */
+struct sample {
+	double t;
+	double v[EV_CNT];
+};
+
+/*
+ * a set of per-thread event counters, where a descriptor is negative if the
+ * event could not be opened
+ */
+struct pmu {
+	int fd[EV_CNT];
+};
+
+#ifdef __linux__
+#define CACHE_EV(c, op, res)                                           \
+	((PERF_COUNT_HW_CACHE_##c) | (PERF_COUNT_HW_CACHE_##op << 8) | \
+	 (PERF_COUNT_HW_CACHE_RESULT_##res << 16))
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} events[EV_CNT] = {
+	[EV_CYC] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[EV_INS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[EV_BRM] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[EV_L1D] = { PERF_TYPE_HW_CACHE, CACHE_EV(L1D, OP_READ, MISS) },
+	[EV_LLC] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+/*
+ * open the counters of pmu p for the calling thread, leaving the ones the
+ * kernel, the hardware or the sandbox refuses to provide closed
+ */
+static void pmu_open(struct pmu *p)
+{
+	for (unsigned k = 0; k != EV_CNT; ++k) {
+		struct perf_event_attr a = { 0 };
+
+		a.size = sizeof a;
+		a.type = events[k].type;
+		a.config = events[k].config;
+		a.disabled = 1;
+		a.exclude_kernel = 1;
+		a.exclude_hv = 1;
+		a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+				PERF_FORMAT_TOTAL_TIME_RUNNING;
+		p->fd[k] = (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+	}
+}
+
+/*
+ * close the counters of pmu p
+ */
+static void pmu_close(struct pmu *p)
+{
+	for (unsigned k = 0; k != EV_CNT; ++k)
+		if (p->fd[k] >= 0)
+			close(p->fd[k]);
+}
+
+/*
+ * reset and start the counters of pmu p
+ */
+static void pmu_start(struct pmu *p)
+{
+	for (unsigned k = 0; k != EV_CNT; ++k)
+		if (p->fd[k] >= 0) {
+			ioctl(p->fd[k], PERF_EVENT_IOC_RESET, 0);
+			ioctl(p->fd[k], PERF_EVENT_IOC_ENABLE, 0);
+		}
+}
+
+/*
+ * stop the counters of pmu p and store their values in s, scaled up
+ * for the time they were multiplexed out
+ */
+static void pmu_stop(struct pmu *p, struct sample *s)
+{
+	for (unsigned k = 0; k != EV_CNT; ++k)
+		if (p->fd[k] >= 0)
+			ioctl(p->fd[k], PERF_EVENT_IOC_DISABLE, 0);
+
+	for (unsigned k = 0; k != EV_CNT; ++k) {
+		uint64_t r[3];
+
+		s->v[k] = -1;
+		if (p->fd[k] < 0 || read(p->fd[k], r, sizeof r) != sizeof r ||
+		    !r[2])
+			continue;
+		s->v[k] = (double)r[0] * ((double)r[1] / (double)r[2]);
+	}
+}
+#else
+static void pmu_open(struct pmu *p)
+{
+	for (unsigned k = 0; k != EV_CNT; ++k)
+		p->fd[k] = -1;
+}
+
+static void pmu_close(struct pmu *p)
+{
+	(void)p;
+}
+
+static void pmu_start(struct pmu *p)
+{
+	(void)p;
+}
+
+static void pmu_stop(struct pmu *p, struct sample *s)
+{
+	(void)p;
+	for (unsigned k = 0; k != EV_CNT; ++k)
+		s->v[k] = -1;
+}
+#endif
+
+/*
+ * monotonic time in seconds
+ */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*
+ * a kernel processes file i to file o until EOF
+ */
+typedef int (*kernel)(FILE *i, FILE *o);
+
+/*
+ * run kernel k over n bytes from src into dst of capacity cap, storing the
+ * length of the output in len and the measurement in s
+ */
+static int run(kernel k, const uint8_t *src, size_t n, uint8_t *dst,
+	       size_t cap, size_t *len, struct pmu *p, struct sample *s)
+{
+	FILE *i, *o;
+	int ret = 0;
+	long l;
+
+	if (UNLIKELY(!(i = fmemopen((void *)src, n, "r"))))
+		return errno;
+	/* leave room for the terminating nul written by fmemopen */
+	if (UNLIKELY(!(o = fmemopen(dst, cap + 1, "w")))) {
+		ret = errno;
+		goto close_i;
+	}
+
+	s->t = now();
+	pmu_start(p);
+	if (LIKELY(!(ret = k(i, o))) && UNLIKELY(fflush(o)))
+		ret = errno;
+	pmu_stop(p, s);
+	s->t = now() - s->t;
+
+	if (UNLIKELY((l = ftell(o)) < 0 && !ret))
+		ret = errno;
+	*len = (size_t)l;
+	if (UNLIKELY(fclose(o) && !ret))
+		ret = errno;
+close_i:
+	fclose(i);
+	return ret;
+}
+
+/*
+ * print an event count per KiB of n bytes, or n/a if unavailable
+ */
+static void print_per_kib(double v, size_t n)
+{
+	if (v < 0)
+		printf(" %12s", "n/a");
+	else
+		printf(" %12.2f", v / ((double)n / 1024));
+}
+
+/*
+ * print the measurement s of kernel k over file f of length n, which
+ * compressed to c bytes
+ */
+static void report(const char *f, const char *k, size_t n, size_t c,
+		   const struct sample *s)
+{
+	printf("%-24s %-10s %9.2f %7.3f", f, k, (double)n / s->t / 1e6,
+	       (double)n / (double)c);
+	if (s->v[EV_CYC] > 0 && s->v[EV_INS] >= 0)
+		printf(" %6.2f", s->v[EV_INS] / s->v[EV_CYC]);
+	else
+		printf(" %6s", "n/a");
+	print_per_kib(s->v[EV_BRM], n);
+	print_per_kib(s->v[EV_L1D], n);
+	print_per_kib(s->v[EV_LLC], n);
+	putchar('\n');
+}
+
+/*
+ * the throughput in MB/s of every trial of kernel k over file f, sorted in
+ * ascending order, and the compression ratio
+ */
+struct result {
+	char *f;
+	char k[16];
+	double ratio;
+	unsigned t;
+	double *mbps;
+};
+
+/*
+ * a growable list of results
+ */
+struct results {
+	struct result *r;
+	size_t n;
+	size_t cap;
+};
+
+/*
+ * append a zeroed result to rs
+ */
+static struct result *results_add(struct results *rs)
+{
+	if (UNLIKELY(rs->n == rs->cap)) {
+		const size_t cap = rs->cap ? rs->cap << 1 : 16;
+		struct result *r = realloc(rs->r, cap * sizeof *r);
+
+		if (UNLIKELY(!r))
+			return NULL;
+		rs->r = r;
+		rs->cap = cap;
+	}
+	return memset(&rs->r[rs->n++], 0, sizeof *rs->r);
+}
+
+/*
+ * release the results rs
+ */
+static void results_free(struct results *rs)
+{
+	for (size_t j = 0; j != rs->n; ++j) {
+		free(rs->r[j].mbps);
+		free(rs->r[j].f);
+	}
+	free(rs->r);
+}
+
+/*
+ * find the result in rs for the same file and kernel as r
+ */
+static const struct result *results_find(const struct results *rs,
+					 const struct result *r)
+{
+	for (size_t j = 0; j != rs->n; ++j)
+		if (!strcmp(rs->r[j].k, r->k) && !strcmp(rs->r[j].f, r->f))
+			return &rs->r[j];
+	return NULL;
+}
+
+/*
+ * order doubles ascending
+ */
+static int cmp_double(const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * median of the n sorted values v
+ */
+static double median(const double *v, unsigned n)
+{
+	return n & 1 ? v[n >> 1] : (v[(n >> 1) - 1] + v[n >> 1]) / 2;
+}
+
+/*
+ * save the results rs to path as lines of kernel, ratio, trial count,
+ * trials and file name, the latter running to the end of the line
+ */
+static int results_save(const struct results *rs, const char *path)
+{
+	FILE *o = fopen(path, "w");
+
+	if (UNLIKELY(!o))
+		return errno;
+	for (size_t j = 0; j != rs->n; ++j) {
+		const struct result *r = &rs->r[j];
+
+		fprintf(o, "%s %.17g %u", r->k, r->ratio, r->t);
+		for (unsigned k = 0; k != r->t; ++k)
+			fprintf(o, " %.17g", r->mbps[k]);
+		fprintf(o, " %s\n", r->f);
+	}
+	if (UNLIKELY(ferror(o))) {
+		fclose(o);
+		return errno ? errno : EIO;
+	}
+	return fclose(o) ? errno : 0;
+}
+
+/*
+ * load the results saved by results_save at path into rs
+ */
+static int results_load(struct results *rs, const char *path)
+{
+	FILE *i = fopen(path, "r");
+	char *ln = NULL;
+	size_t sz = 0;
+	ssize_t len;
+	int ret = 0;
+
+	if (UNLIKELY(!i))
+		return errno;
+
+	while ((len = getline(&ln, &sz, i)) > 0) {
+		struct result *r;
+		int o, m;
+
+		if (ln[len - 1] == '\n')
+			ln[--len] = '\0';
+		if (UNLIKELY(!(r = results_add(rs)))) {
+			ret = ENOMEM;
+			break;
+		}
+		if (UNLIKELY(sscanf(ln, "%15s %lf %u%n", r->k, &r->ratio, &r->t,
+				    &o) != 3 ||
+			     !r->t)) {
+			ret = EINVAL;
+			break;
+		}
+		if (UNLIKELY(!(r->mbps = malloc(r->t * sizeof *r->mbps)))) {
+			ret = ENOMEM;
+			break;
+		}
+		for (unsigned k = 0; k != r->t; ++k, o += m)
+			if (UNLIKELY(sscanf(ln + o, " %lf%n", &r->mbps[k],
+					    &m) != 1)) {
+				ret = EINVAL;
+				goto out;
+			}
+		if (UNLIKELY(ln[o] != ' ' || !ln[o + 1])) {
+			ret = EINVAL;
+			break;
+		}
+		if (UNLIKELY(!(r->f = strdup(ln + o + 1)))) {
+			ret = ENOMEM;
+			break;
+		}
+		qsort(r->mbps, r->t, sizeof *r->mbps, cmp_double);
+	}
+out:
+	if (UNLIKELY(!ret && ferror(i)))
+		ret = errno ? errno : EIO;
+	free(ln);
+	fclose(i);
+	return ret;
+}
+
+/*
+ * one-sided mann-whitney u test on the sorted samples a and b, returning
+ * the probability of a ranking at least as low as that of a if both were
+ * drawn from the same distribution, by the normal approximation with
+ * continuity and tie correction
+ */
+static double mann_whitney(const double *a, unsigned na, const double *b,
+			   unsigned nb)
+{
+	const double n = na + nb;
+	double u = 0, ties = 0, var;
+	unsigned i = 0, j = 0;
+
+	for (unsigned k = 0; k != na; ++k)
+		for (unsigned l = 0; l != nb; ++l)
+			u += a[k] > b[l] ? 1 : a[k] == b[l] ? .5 : 0;
+
+	/* walk runs of equal values through the merge of a and b */
+	while (i != na || j != nb) {
+		const double v = j == nb || (i != na && a[i] <= b[j]) ? a[i] :
+								       b[j];
+		double t = 0;
+
+		for (; i != na && a[i] == v; ++i)
+			++t;
+		for (; j != nb && b[j] == v; ++j)
+			++t;
+		ties += t * t * t - t;
+	}
+
+	var = na * nb / 12. * (n + 1 - ties / (n * (n - 1)));
+	if (!(var > 0))
+		return 1;
+	return erfc(-(u + .5 - na * nb / 2.) / sqrt(2 * var)) / 2;
+}
+
+/*
+ * the format of lzpi from the generic engine, next to lzss_4k of --lzss
+ */
+DEFINE_LZSS(lzss_pi, 8, 8, 8, 2, 1, 8, 1)
+
+/*
+ * the level of recompress_level
+ */
+static enum level level = LEVEL_MAX;
+
+/*
+ * compress file i to file o like compress, then recompress that at level,
+ * as lzpi | lzpi -r level does
+ */
+static int recompress_level(FILE *i, FILE *o)
+{
+	char *b = NULL;
+	size_t n = 0;
+	FILE *m, *r;
+	int ret;
+
+	if (UNLIKELY(!(m = open_memstream(&b, &n))))
+		return errno;
+	ret = compress(i, m);
+	if (UNLIKELY(fclose(m)) && !ret)
+		ret = errno;
+	if (LIKELY(!ret)) {
+		if (UNLIKELY(!(r = fmemopen(b, n, "r"))))
+			ret = errno;
+		else {
+			ret = recompress(r, o, level);
+			fclose(r);
+		}
+	}
+	free(b);
+	return ret;
+}
+
+/*
+ * a setting of the compressor, swept by the pareto report, coding with c
+ * and d at the level l of recompress_level, with the t threads of a frame,
+ * 0 for a thread per cpu, and starting the parser at effort e
+ */
+struct config {
+	const char *name;
+	kernel c;
+	kernel d;
+	enum level l;
+	size_t t;
+	unsigned e;
+};
+
+/*
+ * every setting of the compressor, the first one being the default, each
+ * swept with every set of kernels the cpu supports and every match finder
+ */
+static const struct config configs[] = {
+	{ "greedy", compress, decompress, LEVEL_MAX, 0, EFFORT_MAX },
+	{ "recompress-1", recompress_level, decompress, 1, 0, EFFORT_MAX },
+	{ "recompress-2", recompress_level, decompress, 2, 0, EFFORT_MAX },
+	{ "framed", compress_framed, decompress_framed, LEVEL_MAX, 0,
+	  EFFORT_MAX },
+	{ "framed-1", compress_framed, decompress_framed, LEVEL_MAX, 1,
+	  EFFORT_MAX },
+	{ "framed-2", compress_framed, decompress_framed, LEVEL_MAX, 2,
+	  EFFORT_MAX },
+	{ "framed-4", compress_framed, decompress_framed, LEVEL_MAX, 4,
+	  EFFORT_MAX },
+	{ "effort-0", compress, decompress, LEVEL_MAX, 0, 0 },
+	{ "effort-1", compress, decompress, LEVEL_MAX, 0, 1 },
+	{ "effort-2", compress, decompress, LEVEL_MAX, 0, 2 },
+	{ "effort-3", compress, decompress, LEVEL_MAX, 0, 3 },
+	{ "lzss-pi", lzss_pi_compress, lzss_pi_decompress, LEVEL_MAX, 0,
+	  EFFORT_MAX },
+	{ "lzss-4k", lzss_4k_compress, lzss_4k_decompress, LEVEL_MAX, 0,
+	  EFFORT_MAX },
+};
+
+/*
+ * a file of the corpus loaded into memory
+ */
+struct input {
+	const char *f;
+	uint8_t *src;
+	size_t n;
+};
+
+/*
+ * load file f, or stdin if f is -, into in
+ */
+static int input_load(struct input *in, const char *f)
+{
+	FILE *i = strcmp(f, "-") ? fopen(f, "rb") : stdin;
+	int ret;
+
+	in->f = f;
+	in->src = NULL;
+	if (UNLIKELY(!i))
+		return errno;
+	ret = slurp(i, &in->src, &in->n);
+	if (i != stdin)
+		fclose(i);
+	if (UNLIKELY(!ret && !in->n)) {
+		free(in->src);
+		in->src = NULL;
+		ret = EINVAL;
+	}
+	return ret;
+}
+
+/*
+ * measure compression and decompression of in under the setting cf with t
+ * trials into the results r, storing the fastest trial of each in s and
+ * the compressed length in c
+ */
+static int measure(const struct config *cf, const struct input *in,
+		   unsigned t, struct pmu *p, struct result **r,
+		   struct sample *s, size_t *c)
+{
+	/*
+	 * every group of eight raw bytes costs one control byte, and every
+	 * block of a frame one more and an entry of its table
+	 */
+	const size_t n = in->n,
+		     cap = n + (n + CHAR_BIT - 1) / CHAR_BIT + FRAME_HEADER +
+			   FRAME_TRAILER +
+			   ((n >> FRAME_SHIFT) + 1) * (FRAME_ENTRY + 1);
+	uint8_t *cmp, *dec = NULL;
+	size_t d = 0;
+	int ret = 0;
+
+	if (UNLIKELY(!(cmp = malloc(cap + 1)) || !(dec = malloc(n + 1)))) {
+		ret = ENOMEM;
+		goto out;
+	}
+
+	for (unsigned k = 0; k != 2; ++k) {
+		r[k]->t = t;
+		if (UNLIKELY(!(r[k]->f = strdup(in->f)) ||
+			     !(r[k]->mbps = malloc(t * sizeof *r[k]->mbps)))) {
+			ret = ENOMEM;
+			goto out;
+		}
+	}
+	strcpy(r[0]->k, "compress");
+	strcpy(r[1]->k, "decompress");
+
+	for (unsigned k = 0; k != t; ++k) {
+		struct sample u;
+
+		if (UNLIKELY(ret = run(cf->c, in->src, n, cmp, cap, c, p, &u)))
+			goto out;
+		if (!k || u.t < s[0].t)
+			s[0] = u;
+		r[0]->mbps[k] = (double)n / u.t / 1e6;
+		if (UNLIKELY(ret = run(cf->d, cmp, *c, dec, n, &d, p, &u)))
+			goto out;
+		if (!k || u.t < s[1].t)
+			s[1] = u;
+		r[1]->mbps[k] = (double)n / u.t / 1e6;
+		if (UNLIKELY(d != n || memcmp(in->src, dec, n))) {
+			ret = EILSEQ;
+			goto out;
+		}
+	}
+
+	for (unsigned k = 0; k != 2; ++k) {
+		r[k]->ratio = (double)n / (double)*c;
+		qsort(r[k]->mbps, t, sizeof *r[k]->mbps, cmp_double);
+	}
+out:
+	free(dec);
+	free(cmp);
+	return ret;
+}
+
+/*
+ * the bytes the core decoder reads at a time, like a bootloader reading a
+ * page of flash
+ */
+#define CORE_PAGE 4096
+
+/*
+ * decompress the stream compressed from in with the freestanding decoder
+ * under t trials into the result r, a page of input at a time, storing the
+ * fastest trial in s and the length of the stream in c
+ */
+static int measure_core(const struct input *in, unsigned t, struct pmu *p,
+			struct result *r, struct sample *s, size_t *c)
+{
+	const size_t n = in->n, cap = n + (n + CHAR_BIT - 1) / CHAR_BIT;
+	uint8_t *cmp = NULL, *dec = NULL;
+	struct sample u;
+	int ret = 0;
+
+	r->t = t;
+	strcpy(r->k, "core");
+	if (UNLIKELY(!(r->f = strdup(in->f)) ||
+		     !(r->mbps = malloc(t * sizeof *r->mbps)) ||
+		     !(cmp = malloc(cap + 1)) || !(dec = malloc(n + 1)))) {
+		ret = ENOMEM;
+		goto out;
+	}
+	if (UNLIKELY(ret = run(compress, in->src, n, cmp, cap, c, p, &u)))
+		goto out;
+
+	for (unsigned k = 0; k != t; ++k) {
+		struct lzpi_dec d;
+		size_t i = 0, o = 0;
+
+		u.t = now();
+		pmu_start(p);
+		lzpi_dec_init(&d);
+		for (int e = LZPI_DEC_INPUT; i != *c && e == LZPI_DEC_INPUT;) {
+			size_t ni = *c - i < CORE_PAGE ? *c - i : CORE_PAGE;
+			size_t no = n + 1 - o;
+
+			e = lzpi_dec(&d, cmp + i, &ni, dec + o, &no);
+			i += ni;
+			o += no;
+		}
+		pmu_stop(p, &u);
+		u.t = now() - u.t;
+		if (UNLIKELY(i != *c || !lzpi_dec_done(&d) || o != n ||
+			     memcmp(in->src, dec, n))) {
+			ret = EILSEQ;
+			goto out;
+		}
+		if (!k || u.t < s->t)
+			*s = u;
+		r->mbps[k] = (double)n / u.t / 1e6;
+	}
+
+	r->ratio = (double)n / (double)*c;
+	qsort(r->mbps, t, sizeof *r->mbps, cmp_double);
+out:
+	free(dec);
+	free(cmp);
+	return ret;
+}
+
+/*
+ * a file split into n blobs of z bytes, each compressed with the default
+ * setting into cmp as a stream of s decompressing to dec, c bytes in all,
+ * and as a stream of e compressing to enc
+ */
+struct blobs {
+	struct lzpi_stream *s;
+	struct lzpi_stream *e;
+	size_t n;
+	size_t c;
+	uint8_t *cmp;
+	uint8_t *dec;
+	uint8_t *enc;
+};
+
+/*
+ * split in into blobs of z bytes and compress them into b
+ */
+static int blobs_init(struct blobs *b, const struct input *in, size_t z,
+		      struct pmu *p)
+{
+	/* every group of eight raw bytes costs one control byte */
+	const size_t cap = z + (z + CHAR_BIT - 1) / CHAR_BIT;
+	struct sample u;
+	int ret = 0;
+
+	b->n = (in->n + z - 1) / z;
+	b->c = 0;
+	b->s = calloc(b->n, sizeof *b->s);
+	b->e = calloc(b->n, sizeof *b->e);
+	b->cmp = malloc(b->n * cap + 1);
+	b->dec = malloc(in->n);
+	b->enc = malloc(b->n * cap + 1);
+	if (UNLIKELY(!b->s || !b->e || !b->cmp || !b->dec || !b->enc))
+		return ENOMEM;
+
+	for (size_t j = 0; j != b->n; ++j) {
+		const size_t n = j + 1 == b->n ? in->n - j * z : z;
+		struct lzpi_stream *s = &b->s[j];
+
+		s->in = b->cmp + b->c;
+		if (UNLIKELY(ret = run(compress, in->src + j * z, n,
+				       b->cmp + b->c, cap, &s->n, p, &u)))
+			break;
+		b->c += s->n;
+		s->out = b->dec + j * z;
+		s->cap = n;
+		b->e[j].in = in->src + j * z;
+		b->e[j].n = n;
+		b->e[j].out = b->enc + j * cap;
+		b->e[j].cap = cap;
+	}
+	return ret;
+}
+
+/*
+ * release the blobs b
+ */
+static void blobs_free(struct blobs *b)
+{
+	free(b->enc);
+	free(b->dec);
+	free(b->cmp);
+	free(b->e);
+	free(b->s);
+}
+
+/*
+ * check that the blobs b of in compressed to the same streams as with run
+ */
+static int blobs_check(const struct blobs *b)
+{
+	for (size_t j = 0; j != b->n; ++j)
+		if (UNLIKELY(b->e[j].len != b->s[j].n ||
+			     memcmp(b->e[j].out, b->s[j].in, b->s[j].n)))
+			return EILSEQ;
+	return 0;
+}
+
+/*
+ * compress the blobs b of in if e is set, or else decompress them, under t
+ * trials into the result r, a batch of q at a time, storing the fastest
+ * trial in s
+ */
+static int measure_blobs(const struct input *in, const struct blobs *b, int e,
+			 size_t q, unsigned t, struct pmu *p, struct result *r,
+			 struct sample *s)
+{
+	int (*f)(struct lzpi_stream *, size_t) = e ? lzpi_compress_batch :
+						     lzpi_decompress_batch;
+	struct lzpi_stream *v = e ? b->e : b->s;
+
+	r->t = t;
+	if (UNLIKELY(!(r->f = strdup(in->f)) ||
+		     !(r->mbps = malloc(t * sizeof *r->mbps))))
+		return ENOMEM;
+
+	for (unsigned k = 0; k != t; ++k) {
+		struct sample u;
+		int ret = 0;
+
+		u.t = now();
+		pmu_start(p);
+		for (size_t j = 0; j < b->n && !ret; j += q)
+			ret = f(&v[j], b->n - j < q ? b->n - j : q);
+		pmu_stop(p, &u);
+		u.t = now() - u.t;
+		if (UNLIKELY(ret))
+			return ret;
+		if (UNLIKELY(e ? (ret = blobs_check(b)) :
+				 memcmp(in->src, b->dec, in->n)))
+			return e ? ret : EILSEQ;
+		if (!k || u.t < s->t)
+			*s = u;
+		r->mbps[k] = (double)in->n / u.t / 1e6;
+	}
+
+	r->ratio = (double)in->n / (double)b->c;
+	qsort(r->mbps, t, sizeof *r->mbps, cmp_double);
+	return 0;
+}
+
+/*
+ * the number of results bench produces for a file, with and without
+ * splitting it into blobs
+ */
+#define BENCH_RESULTS(z) ((z) ? 7 : 3)
+
+/*
+ * benchmark compression and decompression of file f with the default
+ * setting and t trials into the results r, reporting the fastest trial,
+ * and of decompression with the freestanding decoder
+ * unless z is 0, also benchmark compressing and decompressing f split into
+ * blobs of z bytes one blob at a time and as a single batch
+ */
+static int bench(const char *f, size_t z, unsigned t, struct pmu *p,
+		 struct result **r)
+{
+	static const char *const names[] = { "c-single",
+					     "c-batch",
+					     "d-single",
+					     "d-batch" };
+	struct sample s[BENCH_RESULTS(1)] = { { 0 } };
+	struct blobs b = { 0 };
+	struct input in;
+	size_t c = 0;
+	int ret;
+
+	if (UNLIKELY(ret = input_load(&in, f)))
+		return ret;
+	if (UNLIKELY(ret = measure(&configs[0], &in, t, p, r, s, &c)))
+		goto out;
+	for (unsigned k = 0; k != 2; ++k)
+		report(f, r[k]->k, in.n, c, &s[k]);
+	if (UNLIKELY(ret = measure_core(&in, t, p, r[2], &s[2], &c)))
+		goto out;
+	report(f, r[2]->k, in.n, c, &s[2]);
+	if (!z)
+		goto out;
+
+	if (UNLIKELY(ret = blobs_init(&b, &in, z, p)))
+		goto out;
+	for (unsigned k = 3; k != BENCH_RESULTS(z); ++k) {
+		strcpy(r[k]->k, names[k - 3]);
+		if (UNLIKELY(ret = measure_blobs(&in, &b, k < 5,
+						 (k - 3) & 1 ? b.n : 1, t, p,
+						 r[k], &s[k])))
+			goto out;
+		report(f, r[k]->k, in.n, b.c, &s[k]);
+	}
+out:
+	blobs_free(&b);
+	free(in.src);
+	return ret;
+}
+
+/*
+ * the data class of file f, which is the name of the directory holding it,
+ * or the name of the file itself if none is given, with its length in n
+ */
+static const char *class_of(const char *f, int *n)
+{
+	const char *e = strrchr(f, '/'), *b = e;
+
+	if (!e || e == f) {
+		*n = (int)strlen(e ? e + 1 : f);
+		return e ? e + 1 : f;
+	}
+	while (b != f && b[-1] != '/')
+		--b;
+	*n = (int)(e - b);
+	return b;
+}
+
+/*
+ * test whether the files f and g belong to the same data class
+ */
+static int same_class(const char *f, const char *g)
+{
+	int m, n;
+	const char *a = class_of(f, &m), *b = class_of(g, &n);
+
+	return m == n && !memcmp(a, b, (size_t)n);
+}
+
+/*
+ * the aggregate performance of a setting over a data class
+ */
+struct point {
+	const struct input *in;
+	const struct config *cf;
+	const struct kernels *kn;
+	enum finder fd;
+	double cmbps;
+	double dmbps;
+	double ratio;
+	int front;
+};
+
+/*
+ * test whether point a dominates point b
+ */
+static int dominates(const struct point *a, const struct point *b)
+{
+	return a->cmbps >= b->cmbps && a->dmbps >= b->dmbps &&
+	       a->ratio >= b->ratio &&
+	       (a->cmbps > b->cmbps || a->dmbps > b->dmbps ||
+		a->ratio > b->ratio);
+}
+
+/*
+ * measure the setting cf with the kernels kn and match finder fd over every
+ * input of in[0:n] in the same data class as in[0] with t trials into pt
+ */
+static int sweep(const struct config *cf, const struct kernels *kn,
+		 enum finder fd, const struct input *in, size_t n, unsigned t,
+		 struct pmu *p, struct point *pt)
+{
+	const struct kernels *k = kern;
+	const enum finder f = find;
+	const enum level l = level;
+	const size_t th = frame_threads;
+	const unsigned e = effort;
+	double bytes = 0, out = 0, tc = 0, td = 0;
+	int ret = 0;
+
+	kern = kn;
+	find = fd;
+	level = cf->l;
+	frame_threads = cf->t;
+	effort = cf->e;
+
+	for (size_t j = 0; j != n; ++j) {
+		struct result a = { 0 }, b = { 0 }, *r[2] = { &a, &b };
+		struct sample s[2];
+		size_t c = 0;
+
+		if (!same_class(in[0].f, in[j].f))
+			continue;
+		ret = measure(cf, &in[j], t, p, r, s, &c);
+		if (LIKELY(!ret)) {
+			bytes += (double)in[j].n;
+			out += (double)c;
+			tc += (double)in[j].n / median(a.mbps, t);
+			td += (double)in[j].n / median(b.mbps, t);
+		}
+		free(a.f);
+		free(a.mbps);
+		free(b.f);
+		free(b.mbps);
+		if (UNLIKELY(ret)) {
+			errno = ret;
+			perror(in[j].f);
+			break;
+		}
+	}
+
+	kern = k;
+	find = f;
+	level = l;
+	frame_threads = th;
+	effort = e;
+	*pt = (struct point){
+		in, cf, kn, fd, bytes / tc, bytes / td, bytes / out, 1
+	};
+	return ret;
+}
+
+/*
+ * sweep every setting over every data class of the inputs in[0:n] with t
+ * trials, printing the pareto frontier of each class and writing every
+ * point to csv unless it is NULL
+ */
+static int pareto(const struct input *in, size_t n, unsigned t,
+		  struct pmu *p, FILE *csv)
+{
+	struct point *pt =
+		malloc(n * ASIZE(configs) * ASIZE(kernels) * FIND_CNT *
+		       sizeof *pt);
+	size_t np = 0;
+	int ret = 0;
+
+	if (UNLIKELY(!pt))
+		return ENOMEM;
+
+	for (size_t j = 0; j != n; ++j) {
+		size_t k = 0, b = np;
+
+		/* the first input of each class stands for all of them */
+		while (k != j && !same_class(in[k].f, in[j].f))
+			++k;
+		if (k != j)
+			continue;
+
+		for (k = 0; k != ASIZE(configs); ++k)
+			for (size_t q = 0; q != ASIZE(kernels); ++q) {
+				if (!kernels_supported(&kernels[q]))
+					continue;
+				for (unsigned f = 0; f != FIND_CNT; ++f)
+					if (UNLIKELY(ret = sweep(
+							     &configs[k],
+							     &kernels[q],
+							     (enum finder)f,
+							     &in[j], n - j, t,
+							     p, &pt[np++])))
+						goto out;
+			}
+
+		for (size_t l = b; l != np; ++l)
+			for (k = b; k != np && pt[l].front; ++k)
+				pt[l].front = !dominates(&pt[k], &pt[l]);
+	}
+
+	printf("%-24s %-20s %12s %14s %7s\n", "class", "setting",
+	       "compress-MB/s", "decompress-MB/s", "ratio");
+	for (size_t j = 0; j != np; ++j) {
+		char nm[64];
+		int m;
+		const char *cls = class_of(pt[j].in->f, &m);
+
+		snprintf(nm, sizeof nm, "%s/%s/%s", pt[j].cf->name,
+			 pt[j].kn->name, finders[pt[j].fd]);
+		if (pt[j].front)
+			printf("%-24.*s %-20s %12.2f %14.2f %7.3f\n", m, cls, nm,
+			       pt[j].cmbps, pt[j].dmbps, pt[j].ratio);
+		if (csv)
+			fprintf(csv, "\"%.*s\",%s,%.6f,%.6f,%.6f,%d\n", m, cls,
+				nm, pt[j].cmbps, pt[j].dmbps, pt[j].ratio,
+				pt[j].front);
+	}
+out:
+	free(pt);
+	return ret;
+}
+
+/*
+ * the significance level at which a change in throughput is reported
+ */
+#define ALPHA 0.05
+
+/*
+ * compare the results cur to the results base, returning 1 if the median
+ * throughput of any kernel dropped significantly by more than thr percent
+ * or its compression ratio dropped by more than thr percent, else 0
+ */
+static int compare(const struct results *base, const struct results *cur,
+		   double thr)
+{
+	int ret = 0;
+
+	printf("\n%-24s %-10s %9s %9s %8s %8s %8s  %s\n", "file", "kernel",
+	       "base-MB/s", "MB/s", "change", "p", "ratio", "verdict");
+
+	for (size_t j = 0; j != cur->n; ++j) {
+		const struct result *c = &cur->r[j];
+		const struct result *b = results_find(base, c);
+		const char *v = "ok";
+		double mb, mc, d, dr, pl;
+
+		if (!b) {
+			printf("%-24s %-10s %9s\n", c->f, c->k, "-");
+			continue;
+		}
+
+		mb = median(b->mbps, b->t);
+		mc = median(c->mbps, c->t);
+		d = (mc / mb - 1) * 100;
+		dr = (c->ratio / b->ratio - 1) * 100;
+		pl = mann_whitney(c->mbps, c->t, b->mbps, b->t);
+
+		if (d < -thr && pl < ALPHA) {
+			v = "REGRESSION";
+			ret = 1;
+		} else if (dr < -thr) {
+			v = "RATIO REGRESSION";
+			ret = 1;
+		} else if (d > thr &&
+			   mann_whitney(b->mbps, b->t, c->mbps, c->t) < ALPHA)
+			v = "improved";
+
+		printf("%-24s %-10s %9.2f %9.2f %+7.2f%% %8.4f %+7.2f%%  %s\n",
+		       c->f, c->k, mb, mc, d, pl, dr, v);
+	}
+
+	return ret;
+}
+
+/*
+ * parse a positive count from s into v
+ */
+static int parse_count(const char *s, unsigned *v)
+{
+	char *e;
+	unsigned long r = strtoul(s, &e, 10);
+
+	if (UNLIKELY(e == s || *e || !r || r > UINT_MAX))
+		return EINVAL;
+	*v = (unsigned)r;
+	return 0;
+}
+
+/*
+ * show usage information and return an error
+ */
+static int usage(const char *restrict name)
+{
+	fprintf(stderr,
+		"Usage:\t\t%s [-r | --trials n] [-o | --save baseline]\n\t\t"
+		"[-b | --baseline baseline] [-t | --threshold percent]\n\t\t"
+		"[-s | --split size] [file...]\n\t\t"
+		"%s --pareto [-r | --trials n] [-c | --csv file] file...\n\n"
+		"Example:\t"
+		"%s -r 10 -o before.txt firmware.bin eeprom.bin\n\t\t"
+		"%s -r 10 -b before.txt firmware.bin eeprom.bin\n\t\t"
+		"%s --split 4096 firmware.bin\n\t\t"
+		"%s --pareto --csv pareto.csv corpus/*/*\n",
+		name, name, name, name, name, name);
+	return 1;
+}
+
+/*
+ * load every file of files[0:n] and print their pareto report with t trials,
+ * also writing it to csv unless it is NULL
+ */
+static int run_pareto(char **files, size_t n, unsigned t, const char *csv)
+{
+	struct input *in = calloc(n, sizeof *in);
+	FILE *o = NULL;
+	struct pmu p;
+	size_t j;
+	int ret = 0;
+
+	if (UNLIKELY(!in))
+		return ENOMEM;
+	for (j = 0; j != n; ++j)
+		if (UNLIKELY(ret = input_load(&in[j], files[j]))) {
+			errno = ret;
+			perror(files[j]);
+			goto out;
+		}
+
+	if (csv) {
+		if (UNLIKELY(!(o = fopen(csv, "w")))) {
+			ret = errno;
+			perror(csv);
+			goto out;
+		}
+		fputs("class,setting,compress_mbps,decompress_mbps,ratio,"
+		      "pareto\n",
+		      o);
+	}
+
+	pmu_open(&p);
+	ret = pareto(in, n, t, &p, o);
+	pmu_close(&p);
+
+	if (o && UNLIKELY((ferror(o) | fclose(o)) && !ret)) {
+		ret = errno ? errno : EIO;
+		perror(csv);
+	}
+out:
+	for (j = 0; j != n; ++j)
+		free(in[j].src);
+	free(in);
+	return ret;
+}
+
+/*
+ * lzpi-bench
+ * accepts optional flags for the number of trials, a file to save the
+ * results to as a baseline, a baseline to compare the results to and the
+ * threshold in percent beyond which a change is a regression
+ * benchmarks each file, or stdin if none is given, and reports throughput
+ * alongside hardware counters where the host allows collecting them, also
+ * for coding it split into blobs one at a time and as a batch with --split
+ * alternatively sweeps every setting of the compressor over the files with
+ * --pareto and reports the pareto frontier of each data class, optionally
+ * also as csv
+ * returns errno on error, or 1 if a regression against the baseline is found
+ */
+int main(int argc, char **argv)
+{
+	static const struct option opts[] = {
+		{ "trials", required_argument, NULL, 'r' },
+		{ "save", required_argument, NULL, 'o' },
+		{ "baseline", required_argument, NULL, 'b' },
+		{ "threshold", required_argument, NULL, 't' },
+		{ "pareto", no_argument, NULL, 'p' },
+		{ "csv", required_argument, NULL, 'c' },
+		{ "split", required_argument, NULL, 's' },
+		{ 0 },
+	};
+	struct results base = { 0 }, cur = { 0 };
+	const char *save = NULL, *load = NULL, *csv = NULL;
+	struct pmu p;
+	unsigned t = 5, z = 0;
+	double thr = 5;
+	int ret = 0, c, par = 0;
+	const char *name = strrchr(argv[0], '/') + 1;
+
+	if (name == (const char *)1)
+		name = argv[0];
+
+	while ((c = getopt_long(argc, argv, "r:o:b:t:pc:s:", opts, NULL)) !=
+	       -1) {
+		char *e;
+
+		switch (c) {
+		case 'r':
+			if (UNLIKELY(parse_count(optarg, &t)))
+				return usage(name);
+			break;
+		case 'o':
+			save = optarg;
+			break;
+		case 'b':
+			load = optarg;
+			break;
+		case 't':
+			thr = strtod(optarg, &e);
+			if (UNLIKELY(e == optarg || *e || !(thr >= 0)))
+				return usage(name);
+			break;
+		case 'p':
+			par = 1;
+			break;
+		case 'c':
+			csv = optarg;
+			break;
+		case 's':
+			if (UNLIKELY(parse_count(optarg, &z)))
+				return usage(name);
+			break;
+		default:
+			return usage(name);
+		}
+	}
+
+	if (par) {
+		if (UNLIKELY(save || load || z || optind == argc))
+			return usage(name);
+		return run_pareto(argv + optind, (size_t)(argc - optind), t,
+				  csv);
+	}
+	if (UNLIKELY(csv))
+		return usage(name);
+
+	if (load && UNLIKELY(ret = results_load(&base, load))) {
+		errno = ret;
+		perror(load);
+		goto out;
+	}
+
+	pmu_open(&p);
+	printf("%-24s %-10s %9s %7s %6s %12s %12s %12s\n", "file", "kernel",
+	       "MB/s", "ratio", "IPC", "br-miss/KiB", "L1D-miss/KiB",
+	       "LLC-miss/KiB");
+
+	for (int j = optind; j < argc || j == optind; ++j) {
+		const char *f = j < argc ? argv[j] : "-";
+		const size_t b = cur.n;
+		struct result *r[BENCH_RESULTS(1)];
+
+		for (unsigned k = 0; !ret && k != BENCH_RESULTS(z); ++k)
+			if (UNLIKELY(!results_add(&cur)))
+				ret = ENOMEM;
+		/* results_add may move earlier results */
+		for (unsigned k = 0; !ret && k != BENCH_RESULTS(z); ++k)
+			r[k] = &cur.r[b + k];
+		if (LIKELY(!ret))
+			ret = bench(f, z, t, &p, r);
+		if (UNLIKELY(ret)) {
+			errno = ret;
+			perror(f);
+			break;
+		}
+	}
+	pmu_close(&p);
+
+	if (UNLIKELY(ret))
+		goto out;
+	if (save && UNLIKELY(ret = results_save(&cur, save))) {
+		errno = ret;
+		perror(save);
+		goto out;
+	}
+	if (load)
+		ret = compare(&base, &cur, thr);
+out:
+	results_free(&cur);
+	results_free(&base);
+	return ret;
+}
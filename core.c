@@ -0,0 +1,167 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * the freestanding decoder core, which needs neither libc nor an allocator
+ * and builds on its own with -ffreestanding for targets without an os
+ */
+
+#include "lzpi.h"
+
+#ifndef __has_builtin
+#define __has_builtin(x) 0
+#endif
+
+#if !(__has_builtin(__builtin_expect) || defined(__builtin_expect))
+#define __builtin_expect(exp, c) (exp)
+#endif
+
+#if !(defined(LIKELY) || defined(UNLIKELY))
+#define LIKELY(exp) __builtin_expect(!!(exp), 1)
+#define UNLIKELY(exp) __builtin_expect(!!(exp), 0)
+#endif
+
+/*
+ * the most bytes a group of eight matches can write and read
+ */
+#define CORE_GROUP_OUT (8 * 256)
+#define CORE_GROUP_IN 17
+
+void lzpi_dec_init(struct lzpi_dec *d)
+{
+	/* history before the start of a stream reads as zeros */
+	for (unsigned k = 0; k != sizeof d->h; ++k)
+		d->h[k] = 0;
+	d->p = 0;
+	d->o = 0;
+	d->s = 0;
+	d->map = 1;
+	d->r = 0;
+}
+
+/*
+ * write n bytes of a match at distance o to op, the first of them from the
+ * history of d for as long as it reaches back past out
+ */
+static uint8_t *core_copy(const struct lzpi_dec *d, const uint8_t *out,
+			  uint8_t *op, unsigned o, unsigned n)
+{
+	const size_t q = (size_t)(op - out);
+
+	if (UNLIKELY(q < o)) {
+		unsigned k = (unsigned)(o - q) < n ? (unsigned)(o - q) : n;
+		uint8_t j = (uint8_t)(d->p + q - o);
+
+		for (n -= k; k; --k)
+			*op++ = d->h[j++];
+	}
+	for (; n; --n, ++op)
+		*op = op[-(ptrdiff_t)o];
+	return op;
+}
+
+/*
+ * keep the last bytes of out[0:n] in the history of d
+ */
+static void core_keep(struct lzpi_dec *d, const uint8_t *out, size_t n)
+{
+	if (n >= sizeof d->h) {
+		out += n - sizeof d->h;
+		for (unsigned k = 0; k != sizeof d->h; ++k)
+			d->h[k] = out[k];
+		d->p = 0;
+		return;
+	}
+	for (size_t k = 0; k != n; ++k)
+		d->h[d->p++] = out[k];
+}
+
+int lzpi_dec(struct lzpi_dec *d, const uint8_t *in, size_t *ni, uint8_t *out,
+	     size_t *no)
+{
+	const uint8_t *ip = in, *const ie = in + *ni;
+	uint8_t *op = out, *const oe = out + *no;
+	unsigned map = d->map, r = d->r, o = d->o + 1u, s = d->s;
+	int ret;
+
+	for (;;) {
+		/* finish a match cut short by the end of the output */
+		if (UNLIKELY(r)) {
+			const unsigned k = (size_t)(oe - op) < r ?
+						   (unsigned)(oe - op) :
+						   r;
+
+			op = core_copy(d, out, op, o, k);
+			if ((r -= k)) {
+				ret = LZPI_DEC_OUTPUT;
+				break;
+			}
+		}
+
+		/* whole groups while neither span can run out */
+		while (map == 1 && !s && ie - ip >= CORE_GROUP_IN &&
+		       oe - op >= CORE_GROUP_OUT)
+			for (map = *ip++ | 0x100u; map != 1; map >>= 1)
+				if (map & 1) {
+					o = *ip++ + 1u;
+					op = core_copy(d, out, op, o, *ip++ + 1u);
+				} else {
+					*op++ = *ip++;
+				}
+
+		if (UNLIKELY(ip == ie)) {
+			ret = LZPI_DEC_INPUT;
+			break;
+		}
+		if (UNLIKELY(s)) {
+			/* the length of a match cut short by the end of the input */
+			r = *ip++ + 1u;
+			s = 0;
+		} else if (map == 1) {
+			map = *ip++ | 0x100u;
+		} else if (map & 1) {
+			o = *ip++ + 1u;
+			map >>= 1;
+			s = 1;
+		} else if (LIKELY(op != oe)) {
+			*op++ = *ip++;
+			map >>= 1;
+		} else {
+			ret = LZPI_DEC_OUTPUT;
+			break;
+		}
+	}
+
+	core_keep(d, out, (size_t)(op - out));
+	d->o = (uint8_t)(o - 1);
+	d->s = (uint8_t)s;
+	d->map = (uint16_t)map;
+	d->r = (uint16_t)r;
+	*ni = (size_t)(ip - in);
+	*no = (size_t)(op - out);
+	return ret;
+}
+
+int lzpi_dec_done(const struct lzpi_dec *d)
+{
+	return !d->s && !d->r && d->map < 0x100;
+}
@@ -0,0 +1,478 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+/*
+ * the generator embeds blobs compressed by lzpi itself in firmware images
+ */
+#define LZPI_NO_MAIN
+#include "lzpi.c"
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * splitmix64, which yields the same sequence for a seed on every host
+ */
+static inline uint64_t rnd(uint64_t *s)
+{
+	uint64_t z = (*s += 0x9e3779b97f4a7c15);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+/*
+ * uniform integer in [0, n)
+ */
+static inline uint32_t rnd_below(uint64_t *s, uint32_t n)
+{
+	return (uint32_t)(((rnd(s) >> 32) * n) >> 32);
+}
+
+/*
+ * uniform integer in [a, b]
+ */
+static inline uint32_t rnd_range(uint64_t *s, uint32_t a, uint32_t b)
+{
+	return a + rnd_below(s, b - a + 1);
+}
+
+/*
+ * uniform real in [0, 1)
+ */
+static inline double rnd_unit(uint64_t *s)
+{
+	return (double)(rnd(s) >> 11) * 0x1p-53;
+}
+
+/*
+ * an output buffer bf with n bytes used out of cap
+ */
+struct out {
+	uint8_t *bf;
+	size_t n;
+	size_t cap;
+};
+
+/*
+ * append byte v to o unless it is full
+ */
+static inline void put8(struct out *o, uint8_t v)
+{
+	if (LIKELY(o->n != o->cap))
+		o->bf[o->n++] = v;
+}
+
+/*
+ * append the little-endian word v to o
+ */
+static inline void put32(struct out *o, uint32_t v)
+{
+	for (unsigned k = 0; k != 4; ++k, v >>= 8)
+		put8(o, (uint8_t)v);
+}
+
+/*
+ * registers of generated instructions, weighted towards the low ones and
+ * sp, lr as in compiled code
+ */
+static const uint8_t regs[] = { 0, 0, 0, 1, 1, 1, 2, 2, 3, 3, 4, 5,
+				6, 7, 8, 12, 13, 13, 14 };
+
+/*
+ * opcodes of generated data processing instructions: add, sub, and, orr
+ */
+static const uint8_t ops[] = { 0x4, 0x2, 0x0, 0xc };
+
+/*
+ * a32 code, as functions of a prologue, a body of data processing, loads,
+ * stores and calls, an epilogue and a literal pool
+ */
+static void gen_code(struct out *o, size_t n, uint64_t *s)
+{
+	const size_t e = o->n + n < o->cap ? o->n + n : o->cap;
+
+	while (o->n < e) {
+		const unsigned len = rnd_range(s, 4, 48);
+		const uint32_t saved = 0x4000 | (0xff0 & (uint32_t)rnd(s));
+
+		put32(o, 0xe92d0000 | saved); /* push {..., lr} */
+		for (unsigned k = 0; k != len; ++k) {
+			const uint32_t rd = regs[rnd_below(s, ASIZE(regs))];
+			const uint32_t rn = regs[rnd_below(s, ASIZE(regs))];
+			const uint32_t op = ops[rnd_below(s, ASIZE(ops))];
+
+			switch (rnd_below(s, 6)) {
+			case 0: /* mov rd, rm */
+				put32(o, 0xe1a00000 | rd << 12 |
+						 regs[rnd_below(s, 8)]);
+				break;
+			case 1: /* op rd, rn, #imm */
+				put32(o, 0xe2000000 | op << 21 | rn << 16 |
+						 rd << 12 | rnd_below(s, 64));
+				break;
+			case 2: /* ldr rd, [rn, #imm] */
+			case 3: /* str rd, [rn, #imm] */
+				put32(o, 0xe5800000 | (k & 1) << 20 | rn << 16 |
+						 rd << 12 | rnd_below(s, 16) << 2);
+				break;
+			case 4: /* cmp rn, #imm; bne */
+				put32(o, 0xe3500000 | rn << 16 |
+						 rnd_below(s, 16));
+				put32(o, 0x1a000000 | rnd_below(s, 16));
+				break;
+			default: /* bl to a nearby function */
+				put32(o, 0xeb000000 |
+						 ((rnd_below(s, 0x2000) - 0x1000) &
+						  0xffffff));
+			}
+		}
+		put32(o, 0xe8bd8000 | saved); /* pop {..., pc} */
+
+		/* literal pool of addresses and constants */
+		for (unsigned k = rnd_below(s, 4); k--;)
+			put32(o, rnd_below(s, 2) ?
+					 0x20000000 | rnd_below(s, 1 << 16) << 2 :
+					 (uint32_t)rnd(s));
+	}
+}
+
+/*
+ * words of generated string tables
+ */
+static const char *const words[] = {
+	"boot",	    "eeprom",	 "config",  "partition", "usb",
+	"sd",	    "network",	 "error",   "timeout",	 "failed",
+	"loading",  "firmware",	 "update",  "recovery",	 "signature",
+	"verify",   "flash",	 "spi",	    "i2c",	 "clock",
+	"voltage",  "temp",	 "mode",    "order",	 "retry",
+	"%s",	    "%d",	 "0x%08x",  "%u",	 "not found",
+	"ready",    "init",	 "device",  "ethernet",	 "tftp",
+	"dhcp",	    "gpio",	 "uart",    "pcie",	 "nvme",
+};
+
+/*
+ * tables of nul-terminated messages aligned to words
+ */
+static void gen_strings(struct out *o, size_t n, uint64_t *s)
+{
+	const size_t e = o->n + n < o->cap ? o->n + n : o->cap;
+
+	while (o->n < e) {
+		for (unsigned k = rnd_range(s, 2, 8); k--;) {
+			for (const char *w = words[rnd_below(s, ASIZE(words))];
+			     *w; ++w)
+				put8(o, (uint8_t)*w);
+			put8(o, k ? ' ' : rnd_below(s, 2) ? '\n' : '\0');
+		}
+		put8(o, '\0');
+		while (o->n & 3 && o->n != o->cap)
+			put8(o, '\0');
+	}
+}
+
+/*
+ * padding of erased flash up to a 4 KiB boundary and a few pages beyond
+ */
+static void gen_padding(struct out *o, uint64_t *s)
+{
+	const size_t n = (o->n | 0xfff) + 1 + (size_t)rnd_below(s, 4) * 4096;
+
+	while (o->n < n && o->n != o->cap)
+		put8(o, 0xff);
+}
+
+/*
+ * arrays of records, each a running index, flags, a constant and a value
+ */
+static void gen_table(struct out *o, size_t n, uint64_t *s)
+{
+	const size_t e = o->n + n < o->cap ? o->n + n : o->cap;
+	const uint32_t step = rnd_range(s, 1, 16), tag = (uint32_t)rnd(s);
+
+	for (uint32_t k = 0; o->n < e; ++k) {
+		put32(o, k * step);
+		put32(o, (tag & 0xffff0000) | rnd_below(s, 4));
+		put32(o, rnd_below(s, 1 << 12));
+	}
+}
+
+/*
+ * a string table compressed by lzpi, preceded by its length as blobs are
+ * stored in boot images
+ */
+static void gen_blob(struct out *o, size_t n, uint64_t *s)
+{
+	struct out t = { NULL, 0, n };
+	const size_t cap = n + (n + CHAR_BIT - 1) / CHAR_BIT;
+	uint8_t *bf = malloc(cap + 1);
+	FILE *i, *c;
+	long l;
+
+	if (UNLIKELY(!bf || !(t.bf = malloc(n))))
+		goto out;
+	gen_strings(&t, n, s);
+	if (UNLIKELY(!(i = fmemopen(t.bf, t.n, "r"))))
+		goto out;
+	if (UNLIKELY(!(c = fmemopen(bf, cap + 1, "w")))) {
+		fclose(i);
+		goto out;
+	}
+	l = !compress(i, c) && !fflush(c) ? ftell(c) : -1;
+	fclose(c);
+	fclose(i);
+
+	if (LIKELY(l > 0)) {
+		put32(o, (uint32_t)l);
+		for (long k = 0; k != l; ++k)
+			put8(o, bf[k]);
+	}
+out:
+	free(t.bf);
+	free(bf);
+}
+
+/*
+ * a firmware image of sections of code, strings, tables, compressed blobs
+ * and erased padding
+ */
+static void gen_firmware(struct out *o, uint64_t *s)
+{
+	while (o->n != o->cap) {
+		const size_t n = rnd_range(s, 1 << 10, 16 << 10);
+		const uint32_t k = rnd_below(s, 20);
+
+		if (k < 8)
+			gen_code(o, n, s);
+		else if (k < 12)
+			gen_strings(o, n, s);
+		else if (k < 15)
+			gen_table(o, n, s);
+		else if (k < 18)
+			gen_blob(o, n, s);
+		else
+			gen_padding(o, s);
+	}
+}
+
+/*
+ * entropy in bits of the geometric distribution of ratio r over bytes
+ */
+static double geometric_entropy(double r)
+{
+	double z = 0, h = 0, p = 1;
+
+	for (unsigned k = 0; k != 1 << CHAR_BIT; ++k, p *= r)
+		z += p;
+	p = 1;
+	for (unsigned k = 0; k != 1 << CHAR_BIT; ++k, p *= r)
+		if (p / z > 0)
+			h -= p / z * log2(p / z);
+	return h;
+}
+
+/*
+ * independent bytes of shannon entropy h bits per byte, drawn from a
+ * geometric distribution over a shuffled alphabet
+ */
+static void gen_entropy(struct out *o, double h, uint64_t *s)
+{
+	double cdf[1 << CHAR_BIT], lo = 0, hi = 1, p = 1, z = 0;
+	uint8_t sym[1 << CHAR_BIT];
+
+	/* the entropy grows with the ratio, from 0 to 8 bits at 1 */
+	for (unsigned k = 0; k != 64; ++k) {
+		const double r = (lo + hi) / 2;
+
+		*(geometric_entropy(r) < h ? &lo : &hi) = r;
+	}
+	for (unsigned k = 0; k != ASIZE(cdf); ++k, p *= hi)
+		cdf[k] = z += p;
+	for (unsigned k = 0; k != ASIZE(sym); ++k) {
+		const unsigned j = rnd_below(s, k + 1);
+
+		sym[k] = sym[j];
+		sym[j] = (uint8_t)k;
+	}
+
+	while (o->n != o->cap) {
+		const double u = rnd_unit(s) * z;
+		unsigned k = 0;
+
+		while (k != ASIZE(cdf) - 1 && cdf[k] <= u)
+			++k;
+		put8(o, sym[k]);
+	}
+}
+
+/*
+ * a random pattern of length p repeated, as in tables of fixed stride
+ */
+static void gen_periodic(struct out *o, size_t p, uint64_t *s)
+{
+	uint8_t *pat = malloc(p);
+
+	if (UNLIKELY(!pat))
+		return;
+	for (size_t k = 0; k != p; ++k)
+		pat[k] = (uint8_t)rnd(s);
+	for (size_t k = 0; o->n != o->cap; k = k + 1 == p ? 0 : k + 1)
+		put8(o, pat[k]);
+	free(pat);
+}
+
+/*
+ * short runs of one byte each broken by some other byte, so that every
+ * position of the dictionary buffer matches a prefix of the lookahead buffer
+ * partially and kmp_search falls back through the chain of its failure
+ * function at each break, while the matches found stay short
+ */
+static void gen_kmp(struct out *o, uint64_t *s)
+{
+	const uint8_t a = (uint8_t)rnd(s);
+
+	while (o->n != o->cap) {
+		for (unsigned k = rnd_range(s, 1, CHAR_BIT); k--;)
+			put8(o, a);
+		put8(o, (uint8_t)(a + rnd_range(s, 1, 255)));
+	}
+}
+
+/*
+ * parse a size with an optional k or m suffix for KiB or MiB from s into v
+ */
+static int parse_size(const char *s, size_t *v)
+{
+	char *e;
+	unsigned long long r = strtoull(s, &e, 10);
+	unsigned sh = 0;
+
+	if (*e == 'k' || *e == 'K')
+		sh = 10;
+	else if (*e == 'm' || *e == 'M')
+		sh = 20;
+	if (UNLIKELY(e == s || e[!!sh] || r > (SIZE_MAX >> sh)))
+		return EINVAL;
+	*v = (size_t)r << sh;
+	return 0;
+}
+
+/*
+ * show usage information and return an error
+ */
+static int usage(const char *restrict name)
+{
+	fprintf(stderr,
+		"Usage:\t\t%s [-s seed] [-n size] firmware | strings | "
+		"entropy:bits | periodic:length | kmp\n\nExample:\t"
+		"%s -s 7 -n 4m firmware >corpus/firmware/7.bin\n\t\t"
+		"%s -n 1m entropy:5.5 >corpus/entropy/5.5.bin\n",
+		name, name, name);
+	return 1;
+}
+
+/*
+ * lzpi-gen
+ * accepts an optional -s flag for the seed and -n flag for the size in bytes,
+ * optionally suffixed by k or m, followed by the kind of data to generate
+ * writes the same data for the same arguments on every host to stdout
+ * returns errno on error
+ */
+int main(int argc, char **argv)
+{
+	struct out o = { NULL, 0, 1 << 20 };
+	uint64_t s = 1;
+	const char *kind;
+	char *e;
+	int ret = 0, c;
+	const char *name = strrchr(argv[0], '/') + 1;
+
+	if (name == (const char *)1)
+		name = argv[0];
+
+	while ((c = getopt(argc, argv, "s:n:")) != -1) {
+		switch (c) {
+		case 's':
+			s = strtoull(optarg, &e, 0);
+			if (UNLIKELY(e == optarg || *e))
+				return usage(name);
+			break;
+		case 'n':
+			if (UNLIKELY(parse_size(optarg, &o.cap)))
+				return usage(name);
+			break;
+		default:
+			return usage(name);
+		}
+	}
+	if (UNLIKELY(optind + 1 != argc))
+		return usage(name);
+	kind = argv[optind];
+
+	if (UNLIKELY(!(o.bf = malloc(o.cap ? o.cap : 1)))) {
+		errno = ENOMEM;
+		perror(name);
+		return ENOMEM;
+	}
+
+	if (!strcmp(kind, "firmware")) {
+		gen_firmware(&o, &s);
+	} else if (!strcmp(kind, "strings")) {
+		gen_strings(&o, o.cap, &s);
+	} else if (!strncmp(kind, "entropy:", 8)) {
+		const double h = strtod(kind + 8, &e);
+
+		if (UNLIKELY(e == kind + 8 || *e || !(h >= 0 && h <= 8)))
+			goto inval;
+		gen_entropy(&o, h, &s);
+	} else if (!strncmp(kind, "periodic:", 9)) {
+		const unsigned long long p = strtoull(kind + 9, &e, 10);
+
+		if (UNLIKELY(e == kind + 9 || *e || !p || p > SIZE_MAX))
+			goto inval;
+		gen_periodic(&o, (size_t)p, &s);
+	} else if (!strcmp(kind, "kmp")) {
+		gen_kmp(&o, &s);
+	} else {
+inval:
+		free(o.bf);
+		return usage(name);
+	}
+
+	if (UNLIKELY(o.n != o.cap)) {
+		ret = ENOMEM;
+		errno = ret;
+		perror(name);
+	} else if (UNLIKELY(fwrite(o.bf, 1, o.n, stdout) != o.n ||
+			    fflush(stdout))) {
+		ret = errno ? errno : EIO;
+		perror(name);
+	}
+	free(o.bf);
+	return ret;
+}
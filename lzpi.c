@@ -20,6 +20,10 @@
  * SOFTWARE.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200112L
 #endif
@@ -27,10 +31,28 @@
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "lzpi.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
 
 #ifndef __has_builtin
 #define __has_builtin(x) 0
@@ -45,36 +67,6 @@
 #define UNLIKELY(exp) __builtin_expect(!!(exp), 0)
 #endif
 
-#ifdef __clang__
-#define CLANG_WI_PS                             \
-	_Pragma("GCC diagnostic push") _Pragma( \
-		"GCC diagnostic ignored \"-Wsometimes-uninitialized\"")
-#define CLANG_WI_PP _Pragma("GCC diagnostic pop")
-#define CLANG_WI(x) CLANG_WI_PS(x) CLANG_WI_PP
-#else
-#define CLANG_WI_PS
-#define CLANG_WI_PP
-#define CLANG_WI(x) (x)
-#endif
-
-#ifndef __clang__
-#define GCC_WI_PS                      \
-	_Pragma("GCC diagnostic push") \
-		_Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
-#define GCC_WI_PP _Pragma("GCC diagnostic pop")
-#define GCC_WI(x)                    \
-	__extension__({              \
-		GCC_WI_PS;           \
-		typeof(x) res = (x); \
-		GCC_WI_PP;           \
-		res;                 \
-	})
-#else
-#define GCC_WI_PS
-#define GCC_WI_PP
-#define GCC_WI(x) (x)
-#endif
-
 #ifdef __INTEL_COMPILER
 #define ICX_WI_PS _Pragma("warning push") _Pragma("warning disable 3656")
 #define ICX_WI_PP _Pragma("warning pop")
@@ -87,6 +79,8 @@
 
 #define ASIZE(x) (sizeof(x) / sizeof *(x))
 
+#include "core.c"
+
 /*
  * the size of a ring must be a power of 2 less than SIZE_MAX & (SIZE_MAX >> 1)
  */
@@ -278,228 +272,3462 @@ struct match {
 	uint8_t l;
 };
 
+static_assert(sizeof(struct match) == 2, "padded struct match");
+
 /*
- * match the lookahead buffer to the dictionary buffer
+ * copy the dictionary and lookahead buffers of w to the linear buffer t
  */
-static struct match match(struct wnd *w)
+static inline void wnd_linear(uint8_t *restrict t, const struct wnd *w)
 {
-	struct match m;
-	struct pair p = kmp_search(w);
-	const size_t tl = w->lookahead.tl;
+	const size_t b = ring_mask(w->dictionary.tl);
+	const size_t r = (RING_SIZE << 1) - b;
+	const size_t n = w->lookahead.hd - w->dictionary.tl;
+
+	if (LIKELY(n <= r)) {
+		memcpy(t, w->bf + b, n);
+	} else {
+		memcpy(t, w->bf + b, r);
+		memcpy(t + r, w->bf, n - r);
+	}
+}
 
-	/* not worth encoding */
-	if (UNLIKELY(
-		    p.l < 2 ||
-		    p.l == 2 && ring_size(&w->lookahead) > 3 &&
-			    w->bf[ring_mask(tl + 2)] == w->bf[ring_mask(tl)] &&
-			    (w->bf[ring_mask(tl + 3)] == w->bf[ring_mask(tl)] ||
-			     w->bf[ring_mask(tl + 3)] ==
-				     w->bf[ring_mask(w->dictionary.tl + p.l)]))) {
-		m.v = w->bf[ring_mask(tl)];
-		m.l = 0;
+/*
+ * copy n > 0 bytes from d - o to d a byte at a time, repeating the last o
+ * bytes where the source overlaps the destination
+ */
+static void copy_scalar(uint8_t *d, size_t o, size_t n)
+{
+	const uint8_t *s = d - o;
 
-		wnd_shift(w, 1);
+	do
+		*d++ = *s++;
+	while (LIKELY(--n));
+}
 
-		return m;
+/*
+ * write the control byte c followed by the n matches m to o, returning the
+ * number of bytes written
+ */
+static size_t group_scalar(uint8_t *restrict o, const struct match *m,
+			   unsigned n, uint32_t c)
+{
+	uint8_t *p = o;
+
+	*p++ = (uint8_t)c;
+	for (unsigned j = 0; j != n; ++j) {
+		*p++ = m[j].v;
+		if (UNLIKELY(m[j].l))
+			*p++ = m[j].l;
 	}
 
-	m.o = (uint8_t)(ring_size(&w->dictionary) - p.o - 1);
-	m.l = (uint8_t)p.l - 1;
+	return (size_t)(p - o);
+}
 
-	wnd_shift(w, p.l);
+/*
+ * the crc32c of every byte, for the reflected castagnoli polynomial
+ */
+static uint32_t crc_lut[1 << CHAR_BIT];
 
-	return m;
+/*
+ * initialize crc_lut
+ */
+static void crc_lut_init(void)
+{
+	for (uint32_t c = 0; c != ASIZE(crc_lut); ++c) {
+		uint32_t v = c;
+
+		for (unsigned j = 0; j != CHAR_BIT; ++j)
+			v = v >> 1 ^ (0x82f63b78 & -(v & 1));
+		crc_lut[c] = v;
+	}
 }
 
 /*
- * encode n matches with control byte c to file o
+ * continue the crc32c c over the n bytes at p, a byte at a time
  */
-static int encode(struct match *restrict m, unsigned n, uint32_t c, FILE *o)
+static uint32_t crc_scalar(uint32_t c, const uint8_t *p, size_t n)
 {
-	unsigned j = 0;
+	for (c = ~c; n; --n)
+		c = c >> CHAR_BIT ^ crc_lut[(c ^ *p++) & 0xff];
+	return ~c;
+}
 
-	/* emit the control byte */
-	if (UNLIKELY(putc_unlocked((int)c, o) < 0))
-		goto fail;
+/*
+ * bytes past the end of a copy or group which the kernels may overwrite
+ */
+#define KERNEL_SLACK 64
 
-	do {
-		if (LIKELY(!m[j].l)) { /* raw byte */
-			if (UNLIKELY(putc_unlocked((int)m[j].v, o) < 0))
-				goto fail;
-		} else { /* back reference */
-			if (UNLIKELY(putc_unlocked((int)m[j].o, o) < 0))
-				goto fail;
-			if (UNLIKELY(putc_unlocked((int)m[j].l, o) < 0))
-				goto fail;
-		}
-	} while (LIKELY(++j != n));
+/*
+ * the number of streams the batch functions process in lockstep, as many as
+ * keep their state in registers
+ */
+#define BATCH_LANES 4
 
-	return 0;
-fail:
-	if (UNLIKELY(!ferror(o)))
-		errno = EIO;
-	return errno;
+/*
+ * the first of the positions left in the masks a of a search over the
+ * dictionary buffer, matching for l bytes
+ */
+static inline struct pair pair_first(const uint64_t *a, size_t l)
+{
+	for (size_t j = 0; l && j != RING_SIZE >> 6; ++j)
+		if (a[j])
+			return (struct pair){
+				(j << 6) + (size_t)__builtin_ctzll(a[j]), l
+			};
+	return (struct pair){ 0 };
 }
 
 /*
- * the compression context
+ * find the longest match like kmp_search in each of the m windows t[i], a
+ * dictionary buffer of d[i] bytes followed by a lookahead buffer of n[i]
+ * bytes, one window at a time
  */
-struct ctx {
-	unsigned n;
-	uint32_t c;
-	uint32_t msk;
+static void kmp_lanes(const uint8_t *const *t, const size_t *d,
+		      const size_t *n, struct pair *p, unsigned m)
+{
 	struct wnd w;
-	struct match m[CHAR_BIT];
-};
 
+	for (unsigned i = 0; i != m; ++i) {
+		w.dictionary = (struct ring){ d[i], 0 };
+		w.lookahead = (struct ring){ d[i] + n[i], d[i] };
+		memcpy(w.bf, t[i], d[i] + n[i]);
+		p[i] = kmp_search(&w);
+	}
+}
+
+#ifdef HAVE_X86
 /*
- * initialize the compression context ctx
+ * find the longest match like kmp_search, for isa comparing v bytes at a
+ * time, where eq1(p, c) is the mask of the v bytes at p equal to c and
+ * eq(p, q) the mask of the v bytes at p equal to those at q; every
+ * position in the dictionary buffer holding the first byte of the lookahead
+ * buffer is extended in order, keeping the first of the longest matches
  */
-static inline void ctx_init(struct ctx *ctx)
+#define DEFINE_SEARCH(name, isa, v, eq1, eq)                                  \
+	__attribute__((target(isa))) static struct pair name(                 \
+		const struct wnd *w)                                          \
+	{                                                                     \
+		uint8_t t[(RING_SIZE << 1) + (v)];                            \
+		const size_t d = ring_size(&w->dictionary);                   \
+		const size_t n = ring_size(&w->lookahead);                    \
+		const uint64_t all = (v) == 64 ? ~(uint64_t)0 :               \
+						 ((uint64_t)1 << (v)) - 1;    \
+		const uint8_t *la = t + d;                                    \
+		struct pair p = { 0 };                                        \
+                                                                              \
+		wnd_linear(t, w);                                             \
+		memset(t + d + n, 0, (v));                                    \
+                                                                              \
+		for (size_t b = 0; b < d; b += (v)) {                         \
+			uint64_t c = eq1(t + b, la[0]);                       \
+                                                                              \
+			if (d - b < (v))                                      \
+				c &= ((uint64_t)1 << (d - b)) - 1;            \
+			for (; c; c &= c - 1) {                               \
+				const size_t o = b + (size_t)__builtin_ctzll(c); \
+				uint64_t m;                                   \
+				size_t l = 1;                                 \
+                                                                              \
+				while (!(m = ~eq(t + o + l, la + l) & all) && \
+				       (l += (v)) < n)                        \
+					;                                     \
+				if (m)                                        \
+					l += (size_t)__builtin_ctzll(m);      \
+				if (UNLIKELY(l >= n))                         \
+					return (struct pair){ o, n };         \
+				if (l > p.l)                                  \
+					p = (struct pair){ o, l };            \
+			}                                                     \
+		}                                                             \
+                                                                              \
+		return p;                                                     \
+	}
+
+#define SSE_EQ1(p, c)                                              \
+	(uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(       \
+		_mm_loadu_si128((const __m128i *)(const void *)(p)), \
+		_mm_set1_epi8((char)(c))))
+#define SSE_EQ(p, q)                                               \
+	(uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(       \
+		_mm_loadu_si128((const __m128i *)(const void *)(p)), \
+		_mm_loadu_si128((const __m128i *)(const void *)(q))))
+#define AVX2_EQ1(p, c)                                                \
+	(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(    \
+		_mm256_loadu_si256((const __m256i *)(const void *)(p)), \
+		_mm256_set1_epi8((char)(c))))
+#define AVX2_EQ(p, q)                                                 \
+	(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(    \
+		_mm256_loadu_si256((const __m256i *)(const void *)(p)), \
+		_mm256_loadu_si256((const __m256i *)(const void *)(q))))
+#define AVX512_EQ1(p, c)                                           \
+	(uint64_t)_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p),    \
+					 _mm512_set1_epi8((char)(c)))
+#define AVX512_EQ(p, q)                                         \
+	(uint64_t)_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p), \
+					 _mm512_loadu_si512(q))
+
+DEFINE_SEARCH(search_sse4_2, "sse4.2", 16, SSE_EQ1, SSE_EQ)
+DEFINE_SEARCH(search_avx2, "avx2", 32, AVX2_EQ1, AVX2_EQ)
+DEFINE_SEARCH(search_avx512, "avx512f,avx512bw", 64, AVX512_EQ1, AVX512_EQ)
+
+/*
+ * the 64-bit mask of the 64 bytes at p equal to c, by eq1 comparing v bytes
+ * at a time
+ */
+#define EQ64(v, eq1, p, c)                                                  \
+	((v) == 64 ? eq1(p, c) :                                            \
+	 (v) == 32 ? eq1(p, c) | eq1((p) + 32, c) << 32 :                   \
+		     eq1(p, c) | eq1((p) + 16, c) << 16 |                   \
+			     eq1((p) + 32, c) << 32 | eq1((p) + 48, c) << 48)
+
+/*
+ * find the longest match like kmp_search at every position of the
+ * dictionary buffer at once, for isa with eq1 as in DEFINE_SEARCH: a bit per
+ * position marks whether it matched every byte of the lookahead buffer so
+ * far, each of which is compared against the whole dictionary buffer, and
+ * the first position left before the last one fails is the match, found at
+ * a cost that depends on its length alone
+ */
+#define DEFINE_SEARCH_ALL(name, isa, v, eq1)                                  \
+	__attribute__((target(isa))) static struct pair name(                 \
+		const struct wnd *w)                                          \
+	{                                                                     \
+		uint8_t t[(RING_SIZE << 1) + RING_SIZE];                      \
+		uint64_t a[RING_SIZE >> 6], b[RING_SIZE >> 6];                \
+		const size_t d = ring_size(&w->dictionary);                   \
+		const size_t n = ring_size(&w->lookahead);                    \
+		const uint8_t *la = t + d;                                    \
+		size_t k, j;                                                  \
+                                                                              \
+		wnd_linear(t, w);                                             \
+		memset(t + d + n, 0, RING_SIZE);                              \
+		for (j = 0; j != ASIZE(a); ++j)                               \
+			a[j] = d >= (j + 1) << 6 ? ~(uint64_t)0 :             \
+			       d > j << 6 ?                                   \
+						((uint64_t)1 << (d & 63)) - 1 :       \
+						0;                                    \
+                                                                              \
+		for (k = 0; k != n; ++k) {                                    \
+			uint64_t any = 0;                                     \
+                                                                              \
+			for (j = 0; j != ASIZE(a); ++j)                       \
+				any |= b[j] = a[j] & EQ64(v, eq1,             \
+							  t + k + (j << 6),   \
+							  la[k]);             \
+			if (!any)                                             \
+				break;                                        \
+			memcpy(a, b, sizeof a);                               \
+		}                                                             \
+                                                                              \
+		for (j = 0; k && j != ASIZE(a); ++j)                          \
+			if (a[j])                                             \
+				return (struct pair){                         \
+					(j << 6) +                            \
+						(size_t)__builtin_ctzll(a[j]), \
+					k                                     \
+				};                                            \
+		return (struct pair){ 0 };                                    \
+	}
+
+static_assert(RING_SIZE >= 64, "too small RING_SIZE for DEFINE_SEARCH_ALL");
+
+DEFINE_SEARCH_ALL(search_all_sse4_2, "sse4.2", 16, SSE_EQ1)
+DEFINE_SEARCH_ALL(search_all_avx2, "avx2", 32, AVX2_EQ1)
+DEFINE_SEARCH_ALL(search_all_avx512, "avx512f,avx512bw", 64, AVX512_EQ1)
+
+/*
+ * find the longest match like DEFINE_SEARCH_ALL in each of the m windows
+ * like those of kmp_lanes, each readable for RING_SIZE bytes past its
+ * lookahead buffer, stepping through all of them in lockstep so that the
+ * compares of one overlap the dependency chain of another
+ */
+#define DEFINE_SEARCH_LANES(name, isa, v, eq1)                                \
+	__attribute__((target(isa))) static void name(                        \
+		const uint8_t *const *t, const size_t *d, const size_t *n,    \
+		struct pair *p, unsigned m)                                   \
+	{                                                                     \
+		uint64_t a[BATCH_LANES][RING_SIZE >> 6];                      \
+		unsigned live = 0, i;                                         \
+		size_t k, j;                                                  \
+                                                                              \
+		for (i = 0; i != m; ++i) {                                    \
+			for (j = 0; j != ASIZE(a[i]); ++j)                    \
+				a[i][j] = d[i] >= (j + 1) << 6 ? ~(uint64_t)0 : \
+					  d[i] > j << 6 ?                     \
+						  ((uint64_t)1 << (d[i] & 63)) - \
+							  1 :                 \
+						  0;                          \
+			p[i] = (struct pair){ 0 };                            \
+			live |= (unsigned)!!n[i] << i;                        \
+		}                                                             \
+                                                                              \
+		for (k = 0; live; ++k)                                        \
+			for (i = 0; i != m; ++i) {                            \
+				uint64_t b[RING_SIZE >> 6], any = 0;          \
+                                                                              \
+				if (!(live >> i & 1))                         \
+					continue;                             \
+				for (j = 0; j != ASIZE(b); ++j)               \
+					any |= b[j] =                         \
+						a[i][j] &                     \
+						EQ64(v, eq1,                  \
+						     t[i] + k + (j << 6),     \
+						     t[i][d[i] + k]);         \
+				if (any)                                      \
+					memcpy(a[i], b, sizeof b);            \
+				if (!any || k + 1 == n[i]) {                  \
+					live &= ~(1u << i);                   \
+					p[i] = pair_first(a[i],               \
+							  any ? k + 1 : k);   \
+				}                                             \
+			}                                                     \
+	}
+
+static_assert(BATCH_LANES <= sizeof(unsigned) * CHAR_BIT,
+	      "too many BATCH_LANES for DEFINE_SEARCH_LANES");
+
+DEFINE_SEARCH_LANES(search_lanes_sse4_2, "sse4.2", 16, SSE_EQ1)
+DEFINE_SEARCH_LANES(search_lanes_avx2, "avx2", 32, AVX2_EQ1)
+DEFINE_SEARCH_LANES(search_lanes_avx512, "avx512f,avx512bw", 64, AVX512_EQ1)
+
+/*
+ * copy like copy_scalar, 16 bytes at a time if the source is at least as
+ * far behind, writing at most 15 bytes past d + n
+ */
+__attribute__((target("sse4.2"))) static void copy_sse4_2(uint8_t *d, size_t o,
+							 size_t n)
 {
-	wnd_init(&ctx->w);
-	ctx->msk = (1 << 31) | (1 << 23) | (1 << 15) | (1 << 7);
+	if (UNLIKELY(o < 16)) {
+		copy_scalar(d, o, n);
+		return;
+	}
+	for (size_t k = 0; k < n; k += 16)
+		_mm_storeu_si128((__m128i *)(void *)(d + k),
+				 _mm_loadu_si128((const __m128i *)(const void *)(
+					 d + k - o)));
 }
 
 /*
- * compresses the current segment of the lookahed buffer to file o
+ * copy like copy_sse4_2, 32 bytes at a time if the source is at least as
+ * far behind, writing at most 31 bytes past d + n
  */
-static int compress_helper(struct ctx *ctx, FILE *o)
+__attribute__((target("avx2"))) static void copy_avx2(uint8_t *d, size_t o,
+						     size_t n)
 {
-	if (UNLIKELY((ctx->msk = rol(ctx->msk)) & 1)) {
-		if (LIKELY(ctx->n)) {
-			int ret;
+	if (UNLIKELY(o < 32)) {
+		copy_sse4_2(d, o, n);
+		return;
+	}
+	for (size_t k = 0; k < n; k += 32)
+		_mm256_storeu_si256((__m256i *)(void *)(d + k),
+				    _mm256_loadu_si256((const __m256i *)(
+					    const void *)(d + k - o)));
+}
 
-			if (UNLIKELY((ret = encode(ctx->m, ctx->n, ctx->c, o))))
-				return ret;
-			ctx->n = 0;
+/*
+ * copy like copy_avx2, 64 bytes at a time if the source is at least as
+ * far behind, writing at most 63 bytes past d + n
+ */
+__attribute__((target("avx512f"))) static void copy_avx512(uint8_t *d,
+							  size_t o, size_t n)
+{
+	if (UNLIKELY(o < 64)) {
+		copy_avx2(d, o, n);
+		return;
+	}
+	for (size_t k = 0; k < n; k += 64)
+		_mm512_storeu_si512(d + k, _mm512_loadu_si512(d + k - o));
+}
+
+/*
+ * shuffles gathering the bytes of a group of matches for each control byte
+ */
+static uint8_t group_lut[1 << CHAR_BIT][16];
+
+/*
+ * initialize group_lut
+ */
+static void group_lut_init(void)
+{
+	for (unsigned c = 0; c != ASIZE(group_lut); ++c) {
+		unsigned k = 0;
+
+		for (unsigned j = 0; j != CHAR_BIT; ++j) {
+			group_lut[c][k++] = (uint8_t)(j << 1);
+			if (c & 1 << j)
+				group_lut[c][k++] = (uint8_t)(j << 1 | 1);
 		}
-		ctx->c = 0;
+		while (k != 16)
+			group_lut[c][k++] = 0x80;
 	}
+}
 
-	ctx->m[ctx->n] = match(&ctx->w);
+/*
+ * write a group like group_scalar with a single shuffle of all eight
+ * matches in m, writing at most 16 bytes past the control byte
+ */
+__attribute__((target("ssse3,popcnt"))) static size_t
+group_ssse3(uint8_t *restrict o, const struct match *m, unsigned n, uint32_t c)
+{
+	const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)m);
 
-	if (LIKELY(ctx->m[ctx->n].l))
-		ctx->c |= ctx->msk;
+	c &= (1 << CHAR_BIT) - 1;
+	*o = (uint8_t)c;
+	_mm_storeu_si128(
+		(__m128i *)(void *)(o + 1),
+		_mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i *)(
+					    const void *)group_lut[c])));
 
-	return 0;
+	return 1 + n + (unsigned)__builtin_popcount(c);
 }
 
 /*
- * compress file i to file o until EOF
+ * continue the crc32c c like crc_scalar with the crc32 instruction, eight
+ * bytes at a time
  */
-static int compress(FILE *i, FILE *o)
+__attribute__((target("sse4.2"))) static uint32_t
+crc_sse4_2(uint32_t c, const uint8_t *p, size_t n)
 {
-	struct ctx ctx;
-	int ret;
+	uint64_t v = ~c;
 
-	ctx_init(&ctx);
+	for (; n >= sizeof v; n -= sizeof v, p += sizeof v) {
+		uint64_t w;
 
-	/* read data from i and compress it */
-	for (ctx.n = 0; LIKELY(!(ret = wnd_read(&ctx.w, i))); ++ctx.n)
-		if (UNLIKELY(ret = compress_helper(&ctx, o)))
-			return ret;
+		memcpy(&w, p, sizeof w);
+		v = _mm_crc32_u64(v, w);
+	}
+	for (c = (uint32_t)v; n; --n)
+		c = _mm_crc32_u8(c, *p++);
+	return ~c;
+}
+#endif
 
-	if (UNLIKELY(ret != EOF))
-		return ret;
+/*
+ * the match finders of a set of kernels
+ * extend tests the positions of the dictionary buffer one by one
+ * all tests all positions of the dictionary buffer at once
+ */
+enum finder { FIND_EXTEND, FIND_ALL, FIND_CNT };
 
-	/* compress the remaining data in the lookahed buffer */
-	for (; LIKELY(ring_size(&ctx.w.lookahead)); ++ctx.n)
-		if (UNLIKELY(ret = compress_helper(&ctx, o)))
-			return ret;
+static const char *const finders[FIND_CNT] = { "extend", "all" };
 
-	/* encode the last remaining bytes */
-	if (LIKELY(ctx.n))
-		return encode(ctx.m, ctx.n, ctx.c, o);
+/*
+ * a set of kernels for an instruction set
+ * search finds the longest match of the lookahead buffer of a window with
+ * each finder, falling back to kmp_search
+ * lanes finds the longest matches of several linear windows, like kmp_lanes
+ * copy expands a match of length n from offset o behind d
+ * group writes a control byte and its group of n matches
+ * crc continues a crc32c over n bytes
+ */
+struct kernels {
+	const char *name;
+	struct pair (*search[FIND_CNT])(const struct wnd *w);
+	void (*lanes)(const uint8_t *const *t, const size_t *d, const size_t *n,
+		      struct pair *p, unsigned m);
+	void (*copy)(uint8_t *d, size_t o, size_t n);
+	size_t (*group)(uint8_t *restrict o, const struct match *m, unsigned n,
+			uint32_t c);
+	uint32_t (*crc)(uint32_t c, const uint8_t *p, size_t n);
+};
 
-	return 0;
+/*
+ * every set of kernels, ordered from the least to the most demanding
+ */
+static const struct kernels kernels[] = {
+	{ "scalar",
+	  { kmp_search, kmp_search },
+	  kmp_lanes,
+	  copy_scalar,
+	  group_scalar,
+	  crc_scalar },
+#ifdef HAVE_X86
+	{ "sse4.2",
+	  { search_sse4_2, search_all_sse4_2 },
+	  search_lanes_sse4_2,
+	  copy_sse4_2,
+	  group_ssse3,
+	  crc_sse4_2 },
+	{ "avx2",
+	  { search_avx2, search_all_avx2 },
+	  search_lanes_avx2,
+	  copy_avx2,
+	  group_ssse3,
+	  crc_sse4_2 },
+	{ "avx512",
+	  { search_avx512, search_all_avx512 },
+	  search_lanes_avx512,
+	  copy_avx512,
+	  group_ssse3,
+	  crc_sse4_2 },
+#endif
+};
+
+/*
+ * the kernels and match finder in use
+ */
+static const struct kernels *kern = kernels;
+static enum finder find = FIND_ALL;
+
+/*
+ * test whether the cpu supports kernels k
+ */
+static int kernels_supported(const struct kernels *k)
+{
+#ifdef HAVE_X86
+	__builtin_cpu_init();
+	if (k->copy == copy_sse4_2)
+		return __builtin_cpu_supports("sse4.2") &&
+		       __builtin_cpu_supports("popcnt");
+	if (k->copy == copy_avx2)
+		return __builtin_cpu_supports("avx2") &&
+		       __builtin_cpu_supports("popcnt");
+	if (k->copy == copy_avx512)
+		return __builtin_cpu_supports("avx512f") &&
+		       __builtin_cpu_supports("avx512bw") &&
+		       __builtin_cpu_supports("popcnt");
+#endif
+	return k == kernels;
 }
 
 /*
- * decompress file i to file o until EOF
+ * use the kernels called name if the cpu supports them
  */
-static int decompress(FILE *i, FILE *o)
+static int kernels_select(const char *name)
 {
-	uint8_t buf[RING_SIZE];
-	struct match m = { 0 };
-	register uint32_t map;
-	register uint32_t msk = (1 << 31) | (1 << 23) | (1 << 15) | (1 << 7);
-	register int c;
+	for (size_t k = 0; k != ASIZE(kernels); ++k)
+		if (!strcmp(name, kernels[k].name)) {
+			if (UNLIKELY(!kernels_supported(&kernels[k])))
+				return ENOTSUP;
+			kern = &kernels[k];
+			return 0;
+		}
+	return EINVAL;
+}
 
-	while (LIKELY((c = getc_unlocked(i)) >= 0)) {
-		if (CLANG_WI(UNLIKELY((msk = rol(msk)) & 1)))
-			if (map = c, UNLIKELY((c = getc_unlocked(i)) < 0))
-				goto readfail;
-		if (GCC_WI(UNLIKELY(map & msk))) {
-			if (m.l = c + 1, UNLIKELY((c = getc_unlocked(i)) < 0))
-				goto readfail;
-			do {
-				buf[m.o] = ICX_WI(buf[(uint8_t)(m.o - m.l)]);
-				if (UNLIKELY(putc_unlocked(buf[m.o++], o) < 0))
-					goto writefail;
-			} while (LIKELY(c--));
-		} else if (buf[m.o++] = c, UNLIKELY(putc_unlocked(c, o) < 0))
-			goto writefail;
-	}
-	if (LIKELY(feof((o = i))))
-		return 0;
-writefail:
-	i = o;
-readfail:
-	if (UNLIKELY(!ferror(i)))
-		errno = EIO;
-	return errno;
+/*
+ * use the match finder called name
+ */
+static int finder_select(const char *name)
+{
+	for (size_t k = 0; k != ASIZE(finders); ++k)
+		if (!strcmp(name, finders[k])) {
+			find = (enum finder)k;
+			return 0;
+		}
+	return EINVAL;
 }
 
 /*
- * show usage information and return an error
+ * use the most demanding kernels the cpu supports, or those named by the
+ * environment variable LZPI_ISA if it supports them, with the match finder
+ * named by the environment variable LZPI_MATCH if any, exiting on a name
+ * that is unknown or unsupported rather than running some other variant
  */
-static int usage(const char *restrict name)
+#ifdef __GNUC__
+__attribute__((constructor))
+#endif
+static void kernels_init(void)
 {
-	fprintf(stderr,
-		"Usage:\t\t%s [-d | --decompress]\n\nExample:\t"
-		"tar -c archive | %s >archive.tar.lzpi\n\t\t"
-		"%s <archive.tar.lzpi | tar -x\n\t\t"
-		"%s -d <archive.tar.lzpi >archive.tar\n",
-		name, name, name, name);
-	return 1;
+	const char *e = getenv("LZPI_ISA");
+	const char *f = getenv("LZPI_MATCH");
+	size_t k = ASIZE(kernels);
+	int ret;
+
+	crc_lut_init();
+#ifdef HAVE_X86
+	group_lut_init();
+#endif
+	while (--k && !kernels_supported(&kernels[k]))
+		;
+	kern = &kernels[k];
+	if (e && UNLIKELY(ret = kernels_select(e))) {
+		fprintf(stderr, "lzpi: LZPI_ISA=%s: %s\n", e, strerror(ret));
+		exit(EXIT_FAILURE);
+	}
+	if (f && UNLIKELY(ret = finder_select(f))) {
+		fprintf(stderr, "lzpi: LZPI_MATCH=%s: %s\n", f, strerror(ret));
+		exit(EXIT_FAILURE);
+	}
 }
 
 /*
- * match -d or --decompress for the decompression flag
+ * the number of distances of the last matches tried before a search
  */
-static inline int match_decompress(const char *s)
+#define REPEATS 2
+
+/*
+ * the whole lookahead buffer of w as the match p at one of the distances of
+ * the last matches, encoded in rep like the offset of a match, if it repeats
+ * there, which no search can better
+ */
+static inline int wnd_repeat(const struct wnd *w, const uint8_t *rep,
+			     struct pair *p)
 {
-	return !strcmp(s, "-d") || !strcmp(s, "--decompress");
+	const size_t d = ring_size(&w->dictionary);
+
+	for (unsigned j = 0; j != REPEATS; ++j) {
+		const size_t o = rep[j] + 1u;
+		size_t k = w->lookahead.tl;
+
+		if (UNLIKELY(o > d))
+			continue;
+		while (k != w->lookahead.hd &&
+		       w->bf[ring_mask(k)] == w->bf[ring_mask(k - o)])
+			++k;
+		if (UNLIKELY(k == w->lookahead.hd)) {
+			*p = (struct pair){ d - o, ring_size(&w->lookahead) };
+			return 1;
+		}
+	}
+	return 0;
 }
 
 /*
- * lzpi
- * accepts an optional -d or --decompress flag for choosing decompression mode
- * reads a file from stdin and writes the processed output to stdout
- * returns errno on error
+ * the lookahead buffer at t + d of n bytes as the match p at one of the
+ * distances rep of the last matches, like wnd_repeat for a linear window
  */
-int main(int argc, char **argv)
+static inline int linear_repeat(const uint8_t *t, size_t d, size_t n,
+				const uint8_t *rep, struct pair *p)
 {
-	int ret;
-	const char *name = strrchr(argv[0], '/') + 1;
+	for (unsigned j = 0; j != REPEATS; ++j) {
+		const size_t o = rep[j] + 1u;
 
-	if (name == (const char *)1)
-		name = argv[0];
+		if (LIKELY(o <= d) && UNLIKELY(!memcmp(t + d, t + d - o, n))) {
+			*p = (struct pair){ d - o, n };
+			return 1;
+		}
+	}
+	return 0;
+}
 
-	switch (argc) {
-	case 1:
-		if (UNLIKELY(ret = compress(stdin, stdout)))
-			perror(name);
-		break;
-	case 2:
-		if (LIKELY(match_decompress(argv[1]))) {
-			if (UNLIKELY(ret = decompress(stdin, stdout)))
-				perror(name);
-			break;
-		} /* fallthrough */
-	default:
-		ret = usage(name);
+/*
+ * remember the offset o of a match among the distances rep of the last ones
+ */
+static inline void repeat_push(uint8_t *rep, uint8_t o)
+{
+	if (o == rep[0])
+		return;
+	memmove(rep + 1, rep, REPEATS - 1);
+	rep[0] = o;
+}
+
+/*
+ * the efforts of the parser under a time budget, from literals alone up to
+ * the full search of compress at EFFORT_MAX, each trying the distances of
+ * the last matches and at most cand positions of the dictionary buffer
+ * holding the first byte of the lookahead buffer, newest first, until a
+ * match of nice bytes
+ */
+static const struct effort {
+	unsigned cand;
+	unsigned nice;
+} efforts[] = { { 0, 0 }, { 2, 8 }, { 8, 32 }, { 32, 128 }, { 0, 0 } };
+
+#define EFFORT_MAX ((unsigned)ASIZE(efforts) - 1)
+
+/*
+ * the effort the parser starts at, the full search unless a benchmark
+ * sweeps the others
+ */
+static unsigned effort = EFFORT_MAX;
+
+/*
+ * search for the longest match of the lookahead buffer in the dictionary
+ * buffer of w with the effort e below EFFORT_MAX
+ */
+static struct pair wnd_bounded(const struct wnd *w, const struct effort *e)
+{
+	uint8_t t[RING_SIZE << 1];
+	const size_t d = ring_size(&w->dictionary);
+	const size_t n = ring_size(&w->lookahead);
+	const uint8_t *la = t + d, *q = t + d;
+	struct pair p = { 0 };
+
+	if (UNLIKELY(!e->cand))
+		return p;
+	wnd_linear(t, w);
+
+	for (unsigned c = e->cand;
+	     c && (q = memrchr(t, la[0], (size_t)(q - t))); --c) {
+		size_t l = 1;
+
+		while (l != n && q[l] == la[l])
+			++l;
+		if (l > p.l) {
+			p = (struct pair){ (size_t)(q - t), l };
+			if (l == n || l >= e->nice)
+				break;
+		}
 	}
-	return ret;
+
+	return p;
 }
+
+/*
+ * match the lookahead buffer to the dictionary buffer, trying the distances
+ * rep of the last matches before searching with the effort e
+ */
+static struct match match(struct wnd *w, uint8_t *rep, unsigned e)
+{
+	struct match m;
+	struct pair p;
+	const size_t tl = w->lookahead.tl;
+
+	if (LIKELY(!wnd_repeat(w, rep, &p)))
+		p = LIKELY(e == EFFORT_MAX) ? kern->search[find](w) :
+					      wnd_bounded(w, &efforts[e]);
+
+	/* not worth encoding */
+	if (UNLIKELY(
+		    p.l < 2 ||
+		    p.l == 2 && ring_size(&w->lookahead) > 3 &&
+			    w->bf[ring_mask(tl + 2)] == w->bf[ring_mask(tl)] &&
+			    (w->bf[ring_mask(tl + 3)] == w->bf[ring_mask(tl)] ||
+			     w->bf[ring_mask(tl + 3)] ==
+				     w->bf[ring_mask(w->dictionary.tl + p.l)]))) {
+		m.v = w->bf[ring_mask(tl)];
+		m.l = 0;
+
+		wnd_shift(w, 1);
+
+		return m;
+	}
+
+	m.o = (uint8_t)(ring_size(&w->dictionary) - p.o - 1);
+	m.l = (uint8_t)p.l - 1;
+	repeat_push(rep, m.o);
+
+	wnd_shift(w, p.l);
+
+	return m;
+}
+
+/*
+ * the size of the buffers between the compressor or decompressor and their
+ * output files
+ */
+#define OUT_SIZE ((size_t)1 << 14)
+
+/*
+ * the longest encoding of a group, a control byte and eight back references
+ */
+#define GROUP_MAX (1 + 2 * CHAR_BIT)
+
+/*
+ * the tokens a parser hands to an emitter at a time while streaming, a
+ * whole number of groups, and the longest encoding of them
+ */
+#define TOKENS_SIZE (CHAR_BIT * CHAR_BIT)
+#define TOKENS_OUT (TOKENS_SIZE / CHAR_BIT * GROUP_MAX)
+static_assert(!(TOKENS_SIZE % CHAR_BIT), "invalid TOKENS_SIZE");
+
+/*
+ * the token stream between a parser and an emitter, the n tokens m with
+ * the control byte c[k] for tokens 8k to 8k + 7, bit j of which is set if
+ * token 8k + j is a match, as in the stream
+ */
+struct tokens {
+	struct match *m;
+	uint8_t *c;
+	size_t n;
+};
+
+/*
+ * append the token m to t
+ */
+static inline void tokens_push(struct tokens *t, struct match m)
+{
+	const size_t k = t->n++;
+
+	if (!(k % CHAR_BIT))
+		t->c[k / CHAR_BIT] = 0;
+	t->c[k / CHAR_BIT] |= (uint8_t)(!!m.l << k % CHAR_BIT);
+	t->m[k] = m;
+}
+
+/*
+ * encode the tokens t to o a group at a time, returning the length of the
+ * output, for which o holds room for GROUP_MAX bytes past its end
+ */
+static size_t tokens_emit(const struct tokens *t, uint8_t *o)
+{
+	uint8_t *p = o;
+
+	for (size_t k = 0; k < t->n; k += CHAR_BIT)
+		p += kern->group(p, t->m + k,
+				 t->n - k < CHAR_BIT ? (unsigned)(t->n - k) :
+						       CHAR_BIT,
+				 t->c[k / CHAR_BIT]);
+	return (size_t)(p - o);
+}
+
+/*
+ * write n bytes from bf to file o
+ */
+static int flush(const uint8_t *bf, size_t n, FILE *o)
+{
+	if (LIKELY(fwrite(bf, 1, n, o) == n))
+		return 0;
+	if (UNLIKELY(!ferror(o)))
+		errno = EIO;
+	return errno;
+}
+
+/*
+ * the size of the ring of input awaiting verification, a power of 2 of at
+ * least twice the most input the tokens emitted at a time and a full
+ * lookahead buffer can add to it, which is 64 KiB
+ */
+#define VERIFY_SIZE ((size_t)1 << 16)
+#define VERIFY_TOKENS (TOKENS_SIZE * RING_SIZE + RING_SIZE)
+static_assert(VERIFY_SIZE >= VERIFY_TOKENS << 1, "too small VERIFY_SIZE");
+static_assert(!(VERIFY_SIZE & (VERIFY_SIZE - 1)), "invalid VERIFY_SIZE");
+
+/*
+ * the state of verifying a compression, which decodes the groups of output
+ * from offset at on with the decoder core and compares that to the input
+ * in[tl:hd] not yet verified, where hd counts the bytes of the window
+ * copied there so far
+ */
+struct verify {
+	struct lzpi_dec d;
+	struct ring r;
+	size_t at;
+	uint8_t in[VERIFY_SIZE];
+	uint8_t out[VERIFY_SIZE];
+};
+
+/*
+ * initialize the verification v
+ */
+static inline void verify_init(struct verify *v)
+{
+	lzpi_dec_init(&v->d);
+	v->r = (struct ring){ 0 };
+	v->at = 0;
+}
+
+/*
+ * copy the bytes read into the lookahead buffer of w since the last call
+ * to v
+ */
+static inline void verify_read(struct verify *v, const struct wnd *w)
+{
+	for (size_t u; v->r.hd != w->lookahead.hd; v->r.hd += u) {
+		const size_t a = ring_mask(v->r.hd);
+		const size_t b = v->r.hd & (VERIFY_SIZE - 1);
+
+		u = w->lookahead.hd - v->r.hd;
+		u = u < (RING_SIZE << 1) - a ? u : (RING_SIZE << 1) - a;
+		u = u < VERIFY_SIZE - b ? u : VERIFY_SIZE - b;
+		memcpy(v->in + b, w->bf + a, u);
+	}
+}
+
+/*
+ * decode the groups ob[at:n] with v and return 0 or EILSEQ if they do not
+ * decode to the oldest input of v
+ */
+static int verify_groups(struct verify *v, const uint8_t *ob, size_t n)
+{
+	size_t i = n - v->at, k = ring_size(&v->r);
+
+	lzpi_dec(&v->d, ob + v->at, &i, v->out, &k);
+	if (UNLIKELY(i != n - v->at))
+		return EILSEQ;
+	for (size_t j = 0, u; j != k; j += u) {
+		const size_t t = (v->r.tl + j) & (VERIFY_SIZE - 1);
+
+		u = VERIFY_SIZE - t < k - j ? VERIFY_SIZE - t : k - j;
+		if (UNLIKELY(memcmp(v->out + j, v->in + t, u)))
+			return EILSEQ;
+	}
+	v->r.tl += k;
+	v->at = n;
+	return 0;
+}
+
+/*
+ * the compression context, parsing the window w with the effort e to the
+ * tokens t backed by m and c for the output buffer ob, and verifying that
+ * with v unless NULL
+ */
+struct ctx {
+	size_t on;
+	uint8_t rep[REPEATS];
+	unsigned e;
+	struct verify *v;
+	struct tokens t;
+	struct wnd w;
+	struct match m[TOKENS_SIZE];
+	uint8_t c[TOKENS_SIZE / CHAR_BIT];
+	uint8_t ob[OUT_SIZE];
+};
+
+/*
+ * initialize the compression context ctx
+ */
+static inline void ctx_init(struct ctx *ctx)
+{
+	wnd_init(&ctx->w);
+	ctx->t = (struct tokens){ ctx->m, ctx->c, 0 };
+	ctx->on = 0;
+	memset(ctx->rep, 0, sizeof ctx->rep);
+	ctx->e = effort;
+	ctx->v = NULL;
+}
+
+/*
+ * emit the tokens of the compression context ctx, writing the output buffer
+ * to file o once it fills up
+ */
+static int encode(struct ctx *ctx, FILE *o)
+{
+	struct verify *const v = ctx->v;
+	int ret;
+
+	ctx->on += tokens_emit(&ctx->t, ctx->ob + ctx->on);
+	ctx->t.n = 0;
+
+	/* verify before the output leaves or the input overruns the ring */
+	if (UNLIKELY(v) &&
+	    (ctx->on > OUT_SIZE - TOKENS_OUT ||
+	     ring_size(&v->r) > VERIFY_SIZE - VERIFY_TOKENS) &&
+	    UNLIKELY(ret = verify_groups(v, ctx->ob, ctx->on)))
+		return ret;
+	if (LIKELY(ctx->on <= OUT_SIZE - TOKENS_OUT))
+		return 0;
+
+	const size_t n = ctx->on;
+
+	ctx->on = 0;
+	if (UNLIKELY(v))
+		v->at = 0;
+	return flush(ctx->ob, n, o);
+}
+
+/*
+ * compresses the current segment of the lookahed buffer to file o
+ */
+static int compress_helper(struct ctx *ctx, FILE *o)
+{
+	int ret;
+
+	if (UNLIKELY(ctx->v))
+		verify_read(ctx->v, &ctx->w);
+
+	/* hand the tokens to the emitter in bulk */
+	if (UNLIKELY(ctx->t.n == TOKENS_SIZE) && UNLIKELY(ret = encode(ctx, o)))
+		return ret;
+
+	/* the literal path takes as much of the lookahead as the tokens hold */
+	if (UNLIKELY(!ctx->e)) {
+		const size_t tl = ctx->w.lookahead.tl;
+		size_t k = ring_size(&ctx->w.lookahead);
+
+		k = k < TOKENS_SIZE - ctx->t.n ? k : TOKENS_SIZE - ctx->t.n;
+		for (size_t j = 0; j != k; ++j)
+			tokens_push(&ctx->t,
+				    (struct match){
+					    .v = ctx->w.bf[ring_mask(tl + j)] });
+		wnd_shift(&ctx->w, k);
+		return 0;
+	}
+
+	tokens_push(&ctx->t, match(&ctx->w, ctx->rep, ctx->e));
+	return 0;
+}
+
+/*
+ * the bytes of input between the adjustments of the effort under a budget
+ */
+#define BUDGET_BLOCK ((size_t)1 << 15)
+
+/*
+ * the margin by which the throughput of an effort must exceed the rate
+ * needed to keep it, and by which that of the current effort must exceed
+ * it to try a higher one not yet measured
+ */
+#define BUDGET_MARGIN 1.25
+#define BUDGET_PROBE 4.0
+
+/*
+ * a budget of the time compression may take, finishing the n bytes of input
+ * by the deadline end in ns if n is set and at least min bytes per ns, the
+ * effort e of the parser, the throughput of each effort so far in rate and
+ * the bytes parsed with it in done, and the block that started at input
+ * position p and time at, checked once the input reaches next
+ */
+struct budget {
+	uint64_t start;
+	uint64_t end;
+	uint64_t at;
+	size_t n;
+	size_t p;
+	size_t next;
+	double min;
+	unsigned e;
+	double rate[EFFORT_MAX + 1];
+	size_t done[EFFORT_MAX + 1];
+};
+
+/*
+ * the monotonic time in ns
+ */
+static inline uint64_t budget_now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+/*
+ * measure the block of b ending at input position p and pick the highest
+ * effort expected to keep up with the rate needed from here on
+ */
+static void budget_step(struct budget *b, size_t p)
+{
+	const uint64_t now = budget_now();
+	const double r = (double)(p - b->p) / (double)(now - b->at + 1);
+	double need = b->min;
+	unsigned e = b->e;
+
+	b->rate[e] = b->rate[e] ? (b->rate[e] + r) / 2 : r;
+	b->done[e] += p - b->p;
+	b->p = p;
+	b->at = now;
+	b->next = p + BUDGET_BLOCK;
+
+	/* past the deadline only the literal path is left */
+	if (UNLIKELY(now >= b->end)) {
+		b->e = 0;
+		return;
+	}
+	if (b->n > p) {
+		const double left = (double)(b->n - p) / (double)(b->end - now);
+
+		need = left > need ? left : need;
+	}
+
+	/* down to the first effort fast enough or not measured yet */
+	while (e && b->rate[e] && b->rate[e] < need * BUDGET_MARGIN)
+		--e;
+	if (e == b->e && e < EFFORT_MAX &&
+	    (b->rate[e + 1] ? b->rate[e + 1] >= need * BUDGET_MARGIN :
+			      r >= need * BUDGET_PROBE))
+		++e;
+	b->e = e;
+}
+
+/*
+ * compress file i to file o until EOF, storing the length of the input in n,
+ * verifying the output with v and keeping to the budget b unless NULL
+ */
+static int compress_len(FILE *i, FILE *o, size_t *n, struct verify *v,
+			struct budget *b)
+{
+	struct ctx ctx;
+	int ret;
+
+	ctx_init(&ctx);
+	ctx.v = v;
+
+	/* read data from i and compress it */
+	while (LIKELY(!(ret = wnd_read(&ctx.w, i)))) {
+		if (UNLIKELY(b) && UNLIKELY(ctx.w.lookahead.tl >= b->next)) {
+			budget_step(b, ctx.w.lookahead.tl);
+			ctx.e = b->e;
+		}
+		if (UNLIKELY(ret = compress_helper(&ctx, o)))
+			return ret;
+	}
+
+	if (UNLIKELY(ret != EOF))
+		return ret;
+
+	/* compress the remaining data in the lookahed buffer */
+	while (LIKELY(ring_size(&ctx.w.lookahead)))
+		if (UNLIKELY(ret = compress_helper(&ctx, o)))
+			return ret;
+
+	/* encode the last remaining bytes */
+	if (LIKELY(ctx.t.n) && UNLIKELY(ret = encode(&ctx, o)))
+		return ret;
+
+	/* every byte read must have been decoded from a whole stream */
+	if (UNLIKELY(v)) {
+		if (UNLIKELY(ret = verify_groups(v, ctx.ob, ctx.on)))
+			return ret;
+		if (UNLIKELY(ring_size(&v->r) || !lzpi_dec_done(&v->d)))
+			return EILSEQ;
+	}
+
+	/* the head of the lookahead buffer counts every byte read */
+	*n = ctx.w.lookahead.hd;
+	if (UNLIKELY(b))
+		budget_step(b, *n);
+	return flush(ctx.ob, ctx.on, o);
+}
+
+/*
+ * compress file i to file o until EOF
+ */
+static int compress(FILE *i, FILE *o)
+{
+	size_t n;
+
+	return compress_len(i, o, &n, NULL, NULL);
+}
+
+/*
+ * the resumable compressor, which parses the window of ctx like compress
+ * and hands out the output buffered in ctx from position p
+ */
+struct lzpi_enc {
+	size_t p;
+	struct ctx ctx;
+};
+
+struct lzpi_enc *lzpi_enc_new(void)
+{
+	struct lzpi_enc *e = malloc(sizeof *e);
+
+	if (LIKELY(e)) {
+		ctx_init(&e->ctx);
+		e->p = 0;
+	}
+	return e;
+}
+
+void lzpi_enc_free(struct lzpi_enc *e)
+{
+	free(e);
+}
+
+/*
+ * copies from ip up to ie into the lookahead buffer of w up to its capacity,
+ * like wnd_read, returning the end of the bytes copied
+ */
+static const uint8_t *wnd_fill(struct wnd *w, const uint8_t *ip,
+			       const uint8_t *ie)
+{
+	while (ip != ie && ring_capacity(&w->lookahead)) {
+		const size_t r = ring_run(&w->lookahead);
+		const size_t c = ring_capacity(&w->lookahead);
+		size_t n = (size_t)(ie - ip);
+
+		n = n < c ? n : c;
+		n = n < r ? n : r;
+		memcpy(w->bf + ring_mask(w->lookahead.hd), ip, n);
+		w->lookahead.hd += n;
+		ip += n;
+	}
+	return ip;
+}
+
+int lzpi_enc(struct lzpi_enc *e, const uint8_t *in, size_t *ni, uint8_t *out,
+	     size_t *no, int end)
+{
+	struct ctx *const ctx = &e->ctx;
+	const uint8_t *ip = in, *const ie = in + *ni;
+	uint8_t *op = out, *const oe = out + *no;
+	int ret;
+
+	for (;;) {
+		/* hand out the output encoded so far */
+		size_t k = ctx->on - e->p;
+
+		k = (size_t)(oe - op) < k ? (size_t)(oe - op) : k;
+		memcpy(op, ctx->ob + e->p, k);
+		op += k;
+		if ((e->p += k) == ctx->on)
+			ctx->on = e->p = 0;
+		if (UNLIKELY(ctx->on > OUT_SIZE - TOKENS_OUT)) {
+			ret = LZPI_DEC_OUTPUT;
+			break;
+		}
+
+		/* search only a full lookahead buffer until the input ends */
+		ip = wnd_fill(&ctx->w, ip, ie);
+		if (UNLIKELY(ring_capacity(&ctx->w.lookahead)) && !end) {
+			ret = LZPI_DEC_INPUT;
+			break;
+		}
+		if (UNLIKELY(!ring_size(&ctx->w.lookahead)) && !ctx->t.n) {
+			/* the output left over did not fit */
+			ret = ctx->on ? LZPI_DEC_OUTPUT : 0;
+			break;
+		}
+
+		if (UNLIKELY(ctx->t.n == TOKENS_SIZE ||
+			     !ring_size(&ctx->w.lookahead))) {
+			ctx->on += tokens_emit(&ctx->t, ctx->ob + ctx->on);
+			ctx->t.n = 0;
+			continue;
+		}
+		tokens_push(&ctx->t, match(&ctx->w, ctx->rep, ctx->e));
+	}
+
+	*ni = (size_t)(ip - in);
+	*no = (size_t)(op - out);
+	return ret;
+}
+
+/*
+ * the encoding state of the stream s of a batch at position p of its input,
+ * writing from op up to oe, with a group of n matches m and control byte c
+ * and the distances rep of the last matches
+ * windows near the ends of the input are copied to w to pad them
+ */
+struct clane {
+	size_t p;
+	uint8_t *op;
+	uint8_t *oe;
+	unsigned n;
+	uint32_t c;
+	uint8_t rep[REPEATS];
+	struct match m[CHAR_BIT];
+	struct lzpi_stream *s;
+	uint8_t w[RING_SIZE * 3];
+};
+
+/*
+ * start encoding the stream s on lane l
+ */
+static inline void clane_init(struct clane *l, struct lzpi_stream *s)
+{
+	l->p = 0;
+	l->op = s->out;
+	l->oe = s->out + s->cap;
+	l->n = 0;
+	l->c = 0;
+	memset(l->rep, 0, sizeof l->rep);
+	l->s = s;
+	s->err = 0;
+}
+
+/*
+ * the window at position p of src[0:len], the dictionary buffer of *d bytes
+ * at *t followed by the lookahead buffer of *n bytes, as wnd_read would fill
+ * it, copied to w and padded for the match finders near the end of src
+ */
+static inline void window_at(const uint8_t *src, size_t len, size_t p,
+			     uint8_t *w, const uint8_t **t, size_t *d,
+			     size_t *n)
+{
+	const size_t r = len - p;
+
+	*d = p < RING_SIZE ? p : RING_SIZE;
+	*n = r < RING_SIZE ? r : RING_SIZE;
+	if (LIKELY(*n + RING_SIZE <= len - (p - *d))) {
+		*t = src + p - *d;
+		return;
+	}
+	memcpy(w, src + p - *d, *d + *n);
+	memset(w + *d + *n, 0, RING_SIZE);
+	*t = w;
+}
+
+/*
+ * write the group of lane l
+ */
+static int clane_encode(struct clane *l)
+{
+	uint8_t g[GROUP_MAX];
+	size_t k;
+
+	if (LIKELY((size_t)(l->oe - l->op) >= GROUP_MAX)) {
+		l->op += kern->group(l->op, l->m, l->n, l->c);
+	} else {
+		if (UNLIKELY((k = kern->group(g, l->m, l->n, l->c)) >
+			     (size_t)(l->oe - l->op)))
+			return ENOBUFS;
+		memcpy(l->op, g, k);
+		l->op += k;
+	}
+	l->n = 0;
+	l->c = 0;
+	return 0;
+}
+
+/*
+ * add a token to the group of lane l for the match p in its window of a
+ * dictionary buffer of d bytes at t followed by a lookahead buffer of n
+ * bytes, exactly like match, writing the group once it is full or the input
+ * ends
+ */
+static int clane_token(struct clane *l, const uint8_t *t, size_t d, size_t n,
+		       struct pair p)
+{
+	const uint8_t *la = t + d;
+	struct match *m = &l->m[l->n];
+
+	/* not worth encoding */
+	if (UNLIKELY(p.l < 2 ||
+		     (p.l == 2 && n > 3 && la[2] == la[0] &&
+		      (la[3] == la[0] || la[3] == t[p.l])))) {
+		m->v = la[0];
+		m->l = 0;
+		++l->p;
+	} else {
+		m->o = (uint8_t)(d - p.o - 1);
+		m->l = (uint8_t)p.l - 1;
+		repeat_push(l->rep, m->o);
+		l->c |= (uint32_t)1 << l->n;
+		l->p += p.l;
+	}
+
+	if (LIKELY(++l->n != CHAR_BIT && l->p != l->s->n))
+		return 0;
+	return clane_encode(l);
+}
+
+int lzpi_compress_batch(struct lzpi_stream *s, size_t n)
+{
+	struct clane l[BATCH_LANES];
+	const uint8_t *t[BATCH_LANES], *u[BATCH_LANES];
+	size_t d[BATCH_LANES], w[BATCH_LANES], e[BATCH_LANES], v[BATCH_LANES];
+	struct pair p[BATCH_LANES], q[BATCH_LANES];
+	unsigned a = 0, b, k, x[BATCH_LANES];
+	size_t j = 0;
+
+	for (;;) {
+		/* finish streams that are done or failed, refilling lanes */
+		for (k = 0; k < a || (a != BATCH_LANES && j != n);) {
+			if (k == a)
+				clane_init(&l[a++], &s[j++]);
+			if (LIKELY(l[k].p != l[k].s->n && !l[k].s->err)) {
+				++k;
+				continue;
+			}
+			l[k].s->len = (size_t)(l[k].op - l[k].s->out);
+			if (j != n)
+				clane_init(&l[k], &s[j++]);
+			else
+				l[k] = l[--a];
+		}
+		if (UNLIKELY(!a))
+			break;
+
+		/* search the lanes whose lookahead does not repeat */
+		for (k = b = 0; k != a; ++k) {
+			window_at(l[k].s->in, l[k].s->n, l[k].p, l[k].w, &t[k],
+				  &d[k], &w[k]);
+			if (LIKELY(!linear_repeat(t[k], d[k], w[k], l[k].rep,
+						  &p[k]))) {
+				u[b] = t[k];
+				e[b] = d[k];
+				v[b] = w[k];
+				x[b++] = k;
+			}
+		}
+		if (LIKELY(b))
+			kern->lanes(u, e, v, q, b);
+		for (k = 0; k != b; ++k)
+			p[x[k]] = q[k];
+		for (k = 0; k != a; ++k)
+			l[k].s->err = clane_token(&l[k], t[k], d[k], w[k], p[k]);
+	}
+
+	for (j = 0; j != n; ++j)
+		if (UNLIKELY(s[j].err))
+			return s[j].err;
+	return 0;
+}
+
+static inline void le32_put(uint8_t *p, uint32_t v)
+{
+	for (unsigned k = 0; k != 4; ++k)
+		p[k] = (uint8_t)(v >> (k * CHAR_BIT));
+}
+
+static inline uint32_t le32_get(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+	       (uint32_t)p[3] << 24;
+}
+
+static inline void le64_put(uint8_t *p, uint64_t v)
+{
+	le32_put(p, (uint32_t)v);
+	le32_put(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint64_t le64_get(const uint8_t *p)
+{
+	return le32_get(p) | (uint64_t)le32_get(p + 4) << 32;
+}
+
+/*
+ * the sized stream, an opt-in raw stream with its raw length: a header of
+ * SIZED_MAGIC, a flag byte and the length as a 64-bit little endian integer,
+ * then the raw stream, followed by the length again if the flag is
+ * SIZED_TAIL, for when it was not known up front
+ */
+#define SIZED_MAGIC "LZPS"
+#define SIZED_TAIL 1
+#define SIZED_HEADER 13
+#define SIZED_FOOTER 8
+
+int lzpi_sized_open(const uint8_t *in, size_t n, struct lzpi_stream *s)
+{
+	uint64_t l;
+
+	if (UNLIKELY(n < SIZED_HEADER || memcmp(in, SIZED_MAGIC, 4) ||
+		     in[4] > SIZED_TAIL))
+		return EILSEQ;
+	s->in = in + SIZED_HEADER;
+	s->n = n - SIZED_HEADER;
+	l = le64_get(in + 5);
+	if (in[4] == SIZED_TAIL) {
+		if (UNLIKELY(s->n < SIZED_FOOTER))
+			return EILSEQ;
+		s->n -= SIZED_FOOTER;
+		l = le64_get(in + n - SIZED_FOOTER);
+	}
+	/* no more than a match of RING_SIZE bytes for every two bytes */
+	if (UNLIKELY(l > SIZE_MAX ||
+		     l / RING_SIZE + !!(l % RING_SIZE) > s->n / 2))
+		return EILSEQ;
+	s->cap = (size_t)l;
+	return 0;
+}
+
+/*
+ * the bytes every token of a group copies up front
+ */
+#define LANE_COPY 16
+
+/*
+ * the input a group may span, with the bytes its last literal copies up
+ * front
+ */
+#define LANE_INPUT (GROUP_MAX + LANE_COPY)
+
+/*
+ * the decoding state of the stream s of a batch, reading from ip up to ie and
+ * writing from op up to oe, at token t of the group with control byte map
+ */
+struct lane {
+	const uint8_t *ip;
+	const uint8_t *ie;
+	uint8_t *op;
+	uint8_t *oe;
+	uint32_t map;
+	unsigned t;
+	struct lzpi_stream *s;
+};
+
+/*
+ * start decoding the stream s on lane l
+ */
+static inline void lane_init(struct lane *l, struct lzpi_stream *s)
+{
+	l->ip = s->in;
+	l->ie = s->in + s->n;
+	l->op = s->out;
+	l->oe = s->out + s->cap;
+	l->t = 0;
+	l->s = s;
+}
+
+/*
+ * whether lane l is at the start of a group with enough input to decode any
+ */
+static inline int lane_fast(const struct lane *l)
+{
+	return !l->t && l->ie - l->ip >= (ptrdiff_t)LANE_INPUT;
+}
+
+/*
+ * the length of the output of the group at i
+ */
+static inline size_t group_size(const uint8_t *i)
+{
+	const unsigned c = *i++;
+	size_t n = CHAR_BIT;
+
+	for (unsigned k = 0; k != CHAR_BIT; ++k) {
+		const size_t b = c >> k & 1;
+
+		n += (size_t)i[1] & -b;
+		i += 1 + b;
+	}
+
+	return n;
+}
+
+/*
+ * whether the group at ip of lane l has room to decode at op with
+ * lane_token_fast
+ */
+static inline int lane_room(const struct lane *l, const uint8_t *ip,
+			    const uint8_t *op)
+{
+	const size_t r = (size_t)(l->oe - op);
+
+	/* only size up the group near the end of the output */
+	return r >= CHAR_BIT * RING_SIZE + KERNEL_SLACK ||
+	       r >= group_size(ip) + KERNEL_SLACK;
+}
+
+/*
+ * finish the match of length n > LANE_COPY or distance o < LANE_COPY at d,
+ * writing at most LANE_COPY - 1 bytes past d + n
+ */
+static inline void lane_copy(uint8_t *d, size_t o, size_t n)
+{
+	if (o < LANE_COPY) {
+		copy_scalar(d, o, n);
+		return;
+	}
+	for (size_t k = LANE_COPY; k < n; k += LANE_COPY)
+		memcpy(d + k, d + k - o, LANE_COPY);
+}
+
+/*
+ * decode token k of the group with control byte c from *ip to *op
+ * the token first copies LANE_COPY bytes from either the input or the
+ * history, which completes literals and short matches without branching on
+ * the type of the token
+ */
+static inline void lane_token_fast(const uint8_t **ip, uint8_t **op,
+				   unsigned c, unsigned k)
+{
+	const uint8_t *i = *ip;
+	uint8_t *o = *op;
+	/* select with masks, a mispredicted branch costs more than both */
+	const size_t b = c >> k & 1;
+	const size_t m = -b;
+	const size_t d = ((size_t)i[0] + 1) & m;
+	const size_t n = ((size_t)i[1] & m) + 1;
+	const uintptr_t h = (uintptr_t)(o - d);
+	uint8_t v[LANE_COPY];
+
+	memcpy(v, (const void *)((h & m) | ((uintptr_t)i & ~m)), sizeof v);
+	memcpy(o, v, sizeof v);
+	if (UNLIKELY(b & ((d < sizeof v) | (n > sizeof v))))
+		lane_copy(o, d, n);
+	*ip = i + 1 + b;
+	*op = o + n;
+}
+
+/*
+ * whether lane l may enter lanes_group
+ */
+static inline int lane_ready(const struct lane *l)
+{
+	return lane_fast(l) && l->op - l->s->out >= (ptrdiff_t)RING_SIZE &&
+	       lane_room(l, l->ip, l->op);
+}
+
+/*
+ * decode whole groups of all BATCH_LANES lanes l in lockstep for as long as
+ * every one of them has input and output to spare, so that their
+ * independent dependency chains overlap
+ * every lane must already have RING_SIZE bytes of history
+ */
+static void lanes_group(struct lane *l)
+{
+	const uint8_t *ip[BATCH_LANES];
+	uint8_t *op[BATCH_LANES];
+	unsigned j;
+
+	for (j = 0; j != BATCH_LANES; ++j) {
+		ip[j] = l[j].ip;
+		op[j] = l[j].op;
+	}
+
+	for (;;) {
+		/* the control bytes of every lane, packed to save registers */
+		uint32_t c = 0;
+
+		for (j = 0; j != BATCH_LANES; ++j)
+			if (UNLIKELY(l[j].ie - ip[j] < (ptrdiff_t)LANE_INPUT ||
+				     !lane_room(&l[j], ip[j], op[j])))
+				goto out;
+		for (j = 0; j != BATCH_LANES; ++j)
+			c |= (uint32_t)*ip[j]++ << (j * CHAR_BIT);
+#ifdef __GNUC__
+#pragma GCC unroll 8
+#endif
+		for (unsigned k = 0; k != CHAR_BIT; ++k)
+#ifdef __GNUC__
+#pragma GCC unroll 8
+#endif
+			for (j = 0; j != BATCH_LANES; ++j)
+				lane_token_fast(&ip[j], &op[j], c >> (j * CHAR_BIT),
+						k);
+	}
+out:
+	for (j = 0; j != BATCH_LANES; ++j) {
+		l[j].ip = ip[j];
+		l[j].op = op[j];
+	}
+}
+
+/*
+ * decode the tokens of a group of lane l until the output runs short or a
+ * match reaches before its start, returning whether any were
+ */
+static int lane_group(struct lane *l)
+{
+	const uint8_t *ip = l->ip;
+	uint8_t *op = l->op;
+	const unsigned c = *ip++;
+	unsigned k;
+
+	for (k = 0; k != CHAR_BIT; ++k) {
+		const size_t b = c >> k & 1;
+		const size_t d = ((size_t)ip[0] + 1) & -b;
+		const size_t n = ((size_t)ip[1] & -b) + 1;
+
+		if (UNLIKELY((size_t)(l->oe - op) < n + KERNEL_SLACK ||
+			     (size_t)(op - l->s->out) < d))
+			break;
+		lane_token_fast(&ip, &op, c, k);
+	}
+
+	if (UNLIKELY(!k))
+		return 0;
+	/* leave the rest of the group to lane_token */
+	l->map = c;
+	l->t = k & (CHAR_BIT - 1);
+	l->ip = ip;
+	l->op = op;
+	return 1;
+}
+
+/*
+ * decode a token of lane l with bounds checks, returning EOF at the end of
+ * its input or an errno value once it fails
+ */
+static int lane_token(struct lane *l)
+{
+	if (UNLIKELY(l->ip == l->ie))
+		return EOF;
+	if (!l->t && (l->map = *l->ip++, UNLIKELY(l->ip == l->ie)))
+		return EIO;
+
+	const unsigned b = l->map >> l->t & 1;
+
+	l->t = (l->t + 1) & (CHAR_BIT - 1);
+	if (LIKELY(!b)) {
+		if (UNLIKELY(l->op == l->oe))
+			return ENOBUFS;
+		*l->op++ = *l->ip++;
+		return 0;
+	}
+	if (UNLIKELY(l->ie - l->ip < 2))
+		return EIO;
+
+	const size_t d = (size_t)l->ip[0] + 1;
+	const size_t n = (size_t)l->ip[1] + 1;
+
+	if (UNLIKELY((size_t)(l->oe - l->op) < n))
+		return ENOBUFS;
+	l->ip += 2;
+	if (LIKELY((size_t)(l->op - l->s->out) >= d)) {
+		copy_scalar(l->op, d, n);
+		l->op += n;
+		return 0;
+	}
+	/* the history before the start of the output reads as zeros */
+	for (size_t k = 0; k != n; ++k, ++l->op)
+		*l->op = (size_t)(l->op - l->s->out) >= d ? *(l->op - d) : 0;
+
+	return 0;
+}
+
+/*
+ * advance lane l by a group, or a token near the ends of its stream,
+ * finishing its stream once done and returning whether it was
+ */
+static int lane_step(struct lane *l)
+{
+	int err;
+
+	if (LIKELY(lane_fast(l) && lane_group(l)))
+		return 0;
+	if (LIKELY(!(err = lane_token(l))))
+		return 0;
+	l->s->len = (size_t)(l->op - l->s->out);
+	l->s->err = err == EOF ? 0 : err;
+	return 1;
+}
+
+int lzpi_decompress_batch(struct lzpi_stream *s, size_t n)
+{
+	struct lane l[BATCH_LANES];
+	size_t a = 0, j = 0;
+
+	while (a != BATCH_LANES && j != n)
+		lane_init(&l[a++], &s[j++]);
+
+	while (LIKELY(a == BATCH_LANES)) {
+		/* bring every lane up to lanes_group, refilling finished ones */
+		for (size_t k = 0; k < a;) {
+			if (lane_ready(&l[k]))
+				++k;
+			else if (UNLIKELY(lane_step(&l[k]))) {
+				if (j != n)
+					lane_init(&l[k], &s[j++]);
+				else
+					l[k] = l[--a];
+			}
+		}
+		if (LIKELY(a == BATCH_LANES))
+			lanes_group(l);
+	}
+
+	/* finish the last streams one at a time */
+	while (a--)
+		while (!lane_step(&l[a]))
+			;
+
+	for (j = 0; j != n; ++j)
+		if (UNLIKELY(s[j].err))
+			return s[j].err;
+	return 0;
+}
+
+/*
+ * a cursor at offset p of buffer k of the n buffers v, having moved len
+ * bytes so far, and set to ENOBUFS in err once writing runs out of them
+ */
+struct iov {
+	const struct iovec *v;
+	size_t n;
+	size_t k;
+	size_t p;
+	size_t len;
+	int err;
+};
+
+/*
+ * copy up to n bytes between b and the buffers of the cursor c, reading
+ * them if rd is set or else writing, and return how many
+ */
+static size_t iov_copy(struct iov *c, void *b, size_t n, int rd)
+{
+	size_t r = 0;
+
+	while (r != n && c->k != c->n) {
+		uint8_t *const p = (uint8_t *)c->v[c->k].iov_base + c->p;
+		const size_t l = c->v[c->k].iov_len - c->p;
+		const size_t u = n - r < l ? n - r : l;
+
+		if (rd)
+			memcpy((uint8_t *)b + r, p, u);
+		else
+			memcpy(p, (const uint8_t *)b + r, u);
+		r += u;
+		if ((c->p += u) == c->v[c->k].iov_len) {
+			++c->k;
+			c->p = 0;
+		}
+	}
+	c->len += r;
+	return r;
+}
+
+static ssize_t iov_read(void *c, char *b, size_t n)
+{
+	return (ssize_t)iov_copy(c, b, n, 1);
+}
+
+static ssize_t iov_write(void *c, const char *b, size_t n)
+{
+	const size_t r = iov_copy(c, (char *)b, n, 0);
+
+	if (UNLIKELY(r != n)) {
+		errno = ((struct iov *)c)->err = ENOBUFS;
+		if (!r)
+			return -1;
+	}
+	return (ssize_t)r;
+}
+
+int lzpi_compressv(const struct iovec *in, size_t ni, const struct iovec *out,
+		   size_t no, size_t *len)
+{
+	const cookie_io_functions_t r = { .read = iov_read };
+	const cookie_io_functions_t w = { .write = iov_write };
+	struct iov ci = { in, ni, 0, 0, 0, 0 }, co = { out, no, 0, 0, 0, 0 };
+	FILE *i, *o = NULL;
+	int ret = ENOMEM;
+
+	/* the compressor reads and writes the buffers without stdio's own */
+	if (UNLIKELY(!(i = fopencookie(&ci, "r", r)) ||
+		     !(o = fopencookie(&co, "w", w))))
+		goto out;
+	setvbuf(i, NULL, _IONBF, 0);
+	setvbuf(o, NULL, _IONBF, 0);
+	/* stdio need not keep the errno of a failed write */
+	if (UNLIKELY(ret = compress(i, o)) && co.err)
+		ret = co.err;
+out:
+	if (o)
+		fclose(o);
+	if (i)
+		fclose(i);
+	*len = co.len;
+	return ret;
+}
+
+int lzpi_decompressv(const struct iovec *in, size_t ni,
+		     const struct iovec *out, size_t no, size_t *len)
+{
+	struct lzpi_dec d;
+	size_t i = 0, o = 0, ip = 0, op = 0;
+
+	/* the decoder core carries the window from one buffer to the next */
+	lzpi_dec_init(&d);
+	*len = 0;
+	for (;;) {
+		size_t u, v;
+
+		for (; i != ni && ip == in[i].iov_len; ++i)
+			ip = 0;
+		for (; o != no && op == out[o].iov_len; ++o)
+			op = 0;
+		if (i == ni && !d.r)
+			return lzpi_dec_done(&d) ? 0 : EIO;
+		/* every token left writes at least a byte */
+		if (o == no)
+			return ENOBUFS;
+
+		/* the rest of a match may need room after the input ran out */
+		u = i != ni ? in[i].iov_len - ip : 0;
+		v = out[o].iov_len - op;
+		lzpi_dec(&d,
+			 i != ni ? (const uint8_t *)in[i].iov_base + ip : d.h, &u,
+			 (uint8_t *)out[o].iov_base + op, &v);
+		ip += u;
+		op += v;
+		*len += v;
+	}
+}
+
+/*
+ * the most threads of the pool, and the jobs in flight per thread it has
+ * room for by default
+ */
+#define POOL_THREADS 64
+#define POOL_DEPTH 4
+
+/*
+ * the pool shared by all jobs, running t threads th once up and until
+ * stop, refusing jobs while it stops, with q jobs queued from hd to *tl, those finished on the stack done
+ * and live jobs in flight out of depth, signalling each finish on the
+ * eventfd fd
+ */
+static struct pool {
+	pthread_mutex_t mu;
+	pthread_cond_t cv;
+	pthread_t th[POOL_THREADS];
+	unsigned t;
+	int up;
+	int stop;
+	int fd;
+	size_t q;
+	size_t live;
+	size_t depth;
+	struct lzpi_job *hd;
+	struct lzpi_job **tl;
+	struct lzpi_job *done;
+} pool = { .mu = PTHREAD_MUTEX_INITIALIZER,
+	   .cv = PTHREAD_COND_INITIALIZER,
+	   .fd = -1 };
+
+static void *pool_run(void *a)
+{
+	(void)a;
+	pthread_mutex_lock(&pool.mu);
+	for (;;) {
+		struct lzpi_job *j[BATCH_LANES];
+		struct lzpi_stream s[BATCH_LANES];
+		const uint64_t one = 1;
+		unsigned n = 0;
+
+		while (!pool.hd && !pool.stop)
+			pthread_cond_wait(&pool.cv, &pool.mu);
+		if (!pool.hd)
+			break;
+
+		/* a run of jobs of one kind in lockstep, leaving none idle */
+		do {
+			j[n] = pool.hd;
+			s[n++] = pool.hd->s;
+			if (!(pool.hd = pool.hd->next))
+				pool.tl = &pool.hd;
+			--pool.q;
+		} while (n != BATCH_LANES && pool.hd && pool.q >= pool.t &&
+			 pool.hd->decompress == j[0]->decompress);
+		pthread_mutex_unlock(&pool.mu);
+
+		if (j[0]->decompress)
+			lzpi_decompress_batch(s, n);
+		else
+			lzpi_compress_batch(s, n);
+
+		pthread_mutex_lock(&pool.mu);
+		while (n--) {
+			j[n]->s = s[n];
+			j[n]->next = pool.done;
+			pool.done = j[n];
+		}
+		(void)!write(pool.fd, &one, sizeof one);
+	}
+	pthread_mutex_unlock(&pool.mu);
+	return NULL;
+}
+
+/*
+ * start the pool like lzpi_pool_start, holding its lock
+ */
+static int pool_start(unsigned t, size_t depth)
+{
+	int ret = 0;
+
+	if (pool.up)
+		return EBUSY;
+	if (!t) {
+		const long c = sysconf(_SC_NPROCESSORS_ONLN);
+
+		t = c < 1 ? 1 : c > POOL_THREADS ? POOL_THREADS : (unsigned)c;
+	}
+	if (t > POOL_THREADS)
+		t = POOL_THREADS;
+	if (UNLIKELY((pool.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0))
+		return errno;
+
+	pool.stop = 0;
+	pool.q = pool.live = 0;
+	pool.depth = depth ? depth : (size_t)t * POOL_DEPTH;
+	pool.hd = pool.done = NULL;
+	pool.tl = &pool.hd;
+	/* run on as many threads as start */
+	for (pool.t = 0; pool.t != t; ++pool.t)
+		if (UNLIKELY(ret = pthread_create(&pool.th[pool.t], NULL,
+						  pool_run, NULL)))
+			break;
+	if (UNLIKELY(!pool.t)) {
+		close(pool.fd);
+		pool.fd = -1;
+		return ret;
+	}
+	pool.up = 1;
+	return 0;
+}
+
+int lzpi_pool_start(unsigned threads, size_t depth)
+{
+	int ret;
+
+	pthread_mutex_lock(&pool.mu);
+	ret = pool_start(threads, depth);
+	pthread_mutex_unlock(&pool.mu);
+	return ret;
+}
+
+int lzpi_submit(struct lzpi_job *j, void (*done)(struct lzpi_job *j))
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pool.mu);
+	if (UNLIKELY(pool.stop))
+		ret = ESHUTDOWN;
+	else if (UNLIKELY(!pool.up))
+		ret = pool_start(0, 0);
+	if (LIKELY(!ret) && UNLIKELY(pool.live == pool.depth))
+		ret = EAGAIN;
+	if (LIKELY(!ret)) {
+		j->done = done;
+		j->next = NULL;
+		*pool.tl = j;
+		pool.tl = &j->next;
+		++pool.q;
+		++pool.live;
+		pthread_cond_signal(&pool.cv);
+	}
+	pthread_mutex_unlock(&pool.mu);
+	return ret;
+}
+
+int lzpi_pool_fd(void)
+{
+	int ret = 0, fd;
+
+	pthread_mutex_lock(&pool.mu);
+	if (UNLIKELY(pool.stop))
+		ret = ESHUTDOWN;
+	else if (UNLIKELY(!pool.up))
+		ret = pool_start(0, 0);
+	fd = pool.fd;
+	pthread_mutex_unlock(&pool.mu);
+	if (UNLIKELY(ret)) {
+		errno = ret;
+		return -1;
+	}
+	return fd;
+}
+
+size_t lzpi_reap(void)
+{
+	struct lzpi_job *d, *r = NULL, *t;
+	uint64_t v;
+	size_t n = 0;
+
+	/* clear the eventfd first, so that a later finish sets it again */
+	pthread_mutex_lock(&pool.mu);
+	if (pool.fd >= 0)
+		(void)!read(pool.fd, &v, sizeof v);
+	d = pool.done;
+	pool.done = NULL;
+	for (; d; d = t, ++n) {
+		t = d->next;
+		d->next = r;
+		r = d;
+	}
+	pool.live -= n;
+	pthread_mutex_unlock(&pool.mu);
+
+	/* the jobs are reversed into the order they finished in */
+	for (; r; r = t) {
+		t = r->next;
+		r->done(r);
+	}
+	return n;
+}
+
+void lzpi_pool_stop(void)
+{
+	pthread_mutex_lock(&pool.mu);
+	if (pool.stop || !pool.up) {
+		/* only the first of several stops joins the threads */
+		while (pool.stop)
+			pthread_cond_wait(&pool.cv, &pool.mu);
+		pthread_mutex_unlock(&pool.mu);
+		return;
+	}
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool.cv);
+	pthread_mutex_unlock(&pool.mu);
+
+	for (unsigned k = 0; k != pool.t; ++k)
+		pthread_join(pool.th[k], NULL);
+	lzpi_reap();
+
+	pthread_mutex_lock(&pool.mu);
+	close(pool.fd);
+	pool.fd = -1;
+	pool.up = pool.stop = 0;
+	pthread_cond_broadcast(&pool.cv);
+	pthread_mutex_unlock(&pool.mu);
+}
+
+#ifndef LZPI_NO_MAIN
+/*
+ * read all of file f into a newly allocated buffer *bf of length *n
+ */
+static int slurp(FILE *f, uint8_t **bf, size_t *n)
+{
+	size_t cap = 1 << 16;
+	uint8_t *b = NULL;
+
+	*n = 0;
+	for (;;) {
+		uint8_t *t;
+
+		if (UNLIKELY(!(t = realloc(b, cap <<= 1)))) {
+			free(b);
+			return ENOMEM;
+		}
+		b = t;
+		*n += fread(b + *n, 1, cap - *n, f);
+		if (*n != cap)
+			break;
+	}
+	if (UNLIKELY(ferror(f))) {
+		free(b);
+		return errno ? errno : EIO;
+	}
+	*bf = b;
+	return 0;
+}
+
+#include "lzss.h"
+
+/*
+ * the codec of --lzss, of 4 KiB windows with 12-bit distances, 4-bit
+ * lengths of at least 3 bytes and flags marking literals
+ */
+DEFINE_LZSS(lzss_4k, 12, 12, 4, 3, 3, 8, 0)
+
+/*
+ * start the budget b of ms milliseconds if positive for the n bytes of
+ * input if known, or 0, and of at least mbps megabytes per second
+ */
+static void budget_init(struct budget *b, double ms, size_t n, double mbps)
+{
+	memset(b, 0, sizeof *b);
+	b->start = b->at = budget_now();
+	b->end = ms > 0 ? b->start + (uint64_t)(ms * 1e6) : UINT64_MAX;
+	b->n = n;
+	b->next = BUDGET_BLOCK;
+	b->min = mbps * 1e-3;
+	b->e = EFFORT_MAX;
+}
+
+/*
+ * compress file i to file o like compress, adjusting the effort to the
+ * budget b started by the caller, the input size of which is taken from i
+ * if that is a regular file
+ */
+static int compress_budget(FILE *i, FILE *o, struct budget *b)
+{
+	struct stat st;
+	size_t n;
+	int ret;
+
+	if (!fstat(fileno(i), &st) && S_ISREG(st.st_mode) &&
+	    st.st_size > 0 && (uintmax_t)st.st_size <= SIZE_MAX)
+		b->n = (size_t)st.st_size;
+	if (UNLIKELY(ret = compress_len(i, o, &n, NULL, b)))
+		errno = ret;
+	return ret;
+}
+
+/*
+ * report the effort the budget b achieved to stderr as name
+ */
+static void budget_report(const struct budget *b, const char *name)
+{
+	const double t = (double)(b->at - b->start) * 1e-6;
+	size_t n = 0;
+	double e = 0;
+
+	for (unsigned k = 0; k <= EFFORT_MAX; ++k) {
+		n += b->done[k];
+		e += (double)b->done[k] * k;
+	}
+	fprintf(stderr,
+		"%s: effort %.2f of %u, %.1f MB/s, %.0f ms\n", name,
+		n ? e / (double)n : (double)EFFORT_MAX, EFFORT_MAX,
+		t > 0 ? (double)n / t * 1e-3 : 0.0, t);
+}
+
+/*
+ * compress file i to file o like compress, decoding each group of output in
+ * turn and failing with EILSEQ as soon as it differs from the input
+ */
+static int compress_verified(FILE *i, FILE *o)
+{
+	struct verify v;
+	size_t n;
+	int ret;
+
+	verify_init(&v);
+	if (UNLIKELY(ret = compress_len(i, o, &n, &v, NULL)))
+		errno = ret;
+	return ret;
+}
+
+/*
+ * decompress file i to file o until EOF
+ */
+static int decompress(FILE *i, FILE *o)
+{
+	/* the last RING_SIZE bytes of output precede those not yet written */
+	uint8_t bf[RING_SIZE + OUT_SIZE + RING_SIZE + KERNEL_SLACK];
+	size_t n = RING_SIZE;
+	register uint32_t map = 0;
+	register uint32_t msk = (1 << 31) | (1 << 23) | (1 << 15) | (1 << 7);
+	register int c;
+	int ret;
+
+	memset(bf, 0, RING_SIZE);
+
+	while (LIKELY((c = getc_unlocked(i)) >= 0)) {
+		if (UNLIKELY((msk = rol(msk)) & 1))
+			if (map = c, UNLIKELY((c = getc_unlocked(i)) < 0))
+				goto readfail;
+		if (UNLIKELY(map & msk)) {
+			const size_t d = (size_t)c + 1;
+
+			if (UNLIKELY((c = getc_unlocked(i)) < 0))
+				goto readfail;
+			kern->copy(bf + n, d, (size_t)c + 1);
+			n += (size_t)c + 1;
+		} else
+			bf[n++] = (uint8_t)c;
+		if (UNLIKELY(n >= RING_SIZE + OUT_SIZE)) {
+			if (UNLIKELY(ret = flush(bf + RING_SIZE, n - RING_SIZE, o)))
+				return ret;
+			memcpy(bf, bf + n - RING_SIZE, RING_SIZE);
+			n = RING_SIZE;
+		}
+	}
+	if (LIKELY(feof(i)))
+		return flush(bf + RING_SIZE, n - RING_SIZE, o);
+readfail:
+	ret = ferror(i) ? errno : EIO;
+	/* keep the output decoded so far, as for a truncated stream */
+	flush(bf + RING_SIZE, n - RING_SIZE, o);
+	errno = ret;
+	return ret;
+}
+
+/*
+ * the parsers of lzpi --recompress, the greedy one of compress and one that
+ * chooses the tokens encoding to the fewest bits
+ */
+enum level { LEVEL_GREEDY = 1, LEVEL_OPTIMAL, LEVEL_MAX = LEVEL_OPTIMAL };
+
+/*
+ * the length of a match beyond which parse_matches takes the matches within
+ * it to be the rest of it rather than searching for them
+ */
+#define PARSE_NICE 64
+
+/*
+ * the bytes the optimal parser chooses tokens for at a time, the bytes past
+ * them it looks at to choose those crossing into the next block, the input
+ * it holds with the history before the block, and the longest encoding of
+ * the tokens of a block with those left over from the last one
+ */
+#define PARSE_BLOCK ((size_t)1 << 16)
+#define PARSE_TAIL (RING_SIZE * 4)
+#define PARSE_SIZE (RING_SIZE + PARSE_BLOCK + PARSE_TAIL)
+#define PARSE_OUT ((PARSE_SIZE + 2 * CHAR_BIT) / CHAR_BIT * GROUP_MAX)
+
+/*
+ * the optimal parser between blocks, with the h bytes of history before the
+ * block in bf followed by the block and the bytes past it, n bytes in all,
+ * the longest match m and the cost c of the rest at each position after the
+ * history, and the tokens t of a group left over from the last block
+ */
+struct parser {
+	size_t h;
+	size_t n;
+	struct tokens t;
+	uint8_t bf[PARSE_SIZE];
+	struct match m[PARSE_SIZE];
+	uint32_t c[PARSE_SIZE + 1];
+	struct match tm[PARSE_SIZE + CHAR_BIT];
+	uint8_t tc[PARSE_SIZE / CHAR_BIT + 2];
+};
+
+/*
+ * start parsing a stream with p
+ */
+static inline void parser_init(struct parser *p)
+{
+	p->h = 0;
+	p->n = 0;
+	p->t = (struct tokens){ p->tm, p->tc, 0 };
+}
+
+/*
+ * the longest match at every position of src[h:n] as encoded, into m from
+ * m[0], of length 0 where no match of at least two bytes exists, or the rest
+ * of a match of more than PARSE_NICE bytes which covers the position
+ */
+static void parse_matches(const uint8_t *src, size_t h, size_t n,
+			  struct match *m)
+{
+	uint8_t w[BATCH_LANES][RING_SIZE * 3];
+	const uint8_t *t[BATCH_LANES];
+	size_t d[BATCH_LANES], l[BATCH_LANES];
+	struct pair p[BATCH_LANES];
+
+	for (size_t i = h; i < n;) {
+		const unsigned a = n - i < BATCH_LANES ? (unsigned)(n - i) :
+							 BATCH_LANES;
+		size_t e = i + a;
+
+		for (unsigned k = 0; k != a; ++k)
+			window_at(src, n, i + k, w[k], &t[k], &d[k], &l[k]);
+		kern->lanes(t, d, l, p, a);
+		for (unsigned k = 0; k != a; ++k) {
+			m[i + k - h].o = (uint8_t)(d[k] - p[k].o - 1);
+			m[i + k - h].l = p[k].l < 2 ? 0 : (uint8_t)(p[k].l - 1);
+		}
+
+		/* skip the searches within long matches */
+		for (unsigned k = 0; k != a; ++k)
+			for (; p[k].l > PARSE_NICE && e < i + k + p[k].l - PARSE_NICE;
+			     ++e) {
+				m[e - h].o = m[i + k - h].o;
+				m[e - h].l = (uint8_t)(m[i + k - h].l - (e - i - k));
+			}
+		i = e;
+	}
+}
+
+/*
+ * shorten or drop the longest matches m at every position of n bytes to the
+ * tokens that encode them to the fewest bits, with the cost in bits of the
+ * rest from each position in c, a literal costing a byte and a match two,
+ * each with a bit of its control byte, preferring longer matches among
+ * equals and keeping those longer than PARSE_NICE bytes
+ */
+static void parse_optimal(size_t n, struct match *m, uint32_t *c)
+{
+	c[n] = 0;
+	for (size_t i = n; i--;) {
+		uint32_t b = c[i + 1] + CHAR_BIT + 1;
+		unsigned x = 0;
+
+		/* take long matches whole, as parse_matches does */
+		if (m[i].l >= PARSE_NICE) {
+			c[i] = c[i + m[i].l + 1] + 2 * CHAR_BIT + 1;
+			continue;
+		}
+		for (unsigned l = 2; l <= m[i].l + 1u; ++l)
+			if (c[i + l] + 2 * CHAR_BIT + 1 <= b) {
+				b = c[i + l] + 2 * CHAR_BIT + 1;
+				x = l;
+			}
+		c[i] = b;
+		m[i].l = x ? (uint8_t)(x - 1) : 0;
+	}
+}
+
+/*
+ * choose the tokens of the block of p, or of all its input if end is set,
+ * encode the whole groups of them to o, which has room for PARSE_OUT bytes,
+ * and keep the history and the input of the next block, returning the
+ * length of the output
+ * but for the last, a block is parsed with PARSE_TAIL bytes past it in view
+ * and ends with the token crossing into them
+ */
+static size_t parser_step(struct parser *p, int end, uint8_t *o)
+{
+	const size_t n = p->n - p->h, b = end ? n : PARSE_BLOCK;
+	size_t i = 0, k, r;
+
+	parse_matches(p->bf, p->h, p->n, p->m);
+	parse_optimal(n, p->m, p->c);
+	while (i < b) {
+		struct match x = p->m[i];
+
+		if (x.l)
+			i += x.l + 1u;
+		else
+			x.v = p->bf[p->h + i++];
+		tokens_push(&p->t, x);
+	}
+
+	/* the tokens short of a group wait for the next block */
+	r = end ? 0 : p->t.n % CHAR_BIT;
+	p->t.n -= r;
+	k = tokens_emit(&p->t, o);
+	if (r) {
+		memmove(p->t.m, p->t.m + p->t.n, r * sizeof *p->t.m);
+		p->t.c[0] = p->t.c[p->t.n / CHAR_BIT];
+	}
+	p->t.n = r;
+
+	i += p->h;
+	p->h = i < RING_SIZE ? i : RING_SIZE;
+	memmove(p->bf, p->bf + i - p->h, p->n - i + p->h);
+	p->n -= i - p->h;
+	return k;
+}
+
+/*
+ * recompress the stream of file i to file o with the parser of level l,
+ * decoding it a block at a time straight into the input of the parser, and
+ * copy the stream as it is unless that makes it smaller, which is decided
+ * as soon as the new one grows as long
+ */
+static int recompress(FILE *i, FILE *o, enum level l)
+{
+	uint8_t *cmp = NULL, *out = NULL;
+	struct lzpi_enc *e = NULL;
+	struct parser *p = NULL;
+	struct lzpi_dec d;
+	size_t c, at = 0, k = 0;
+	int ret, r;
+
+	if (UNLIKELY(ret = slurp(i, &cmp, &c)))
+		return ret;
+	if (UNLIKELY(!(out = malloc(c + PARSE_OUT)) ||
+		     !(p = malloc(sizeof *p)) ||
+		     (l == LEVEL_GREEDY && !(e = lzpi_enc_new())))) {
+		ret = ENOMEM;
+		goto out;
+	}
+
+	parser_init(p);
+	lzpi_dec_init(&d);
+	do {
+		size_t ni = c - at, no = PARSE_SIZE - p->n;
+
+		r = lzpi_dec(&d, cmp + at, &ni, p->bf + p->n, &no);
+		at += ni;
+		p->n += no;
+
+		/* past the length of the stream only its check is left */
+		if (k >= c) {
+			p->n = 0;
+		} else if (l == LEVEL_GREEDY) {
+			ni = p->n;
+			no = c - k;
+			if (lzpi_enc(e, p->bf, &ni, out + k, &no,
+				     r == LZPI_DEC_INPUT) == LZPI_DEC_OUTPUT)
+				no = c - k;
+			k += no;
+			p->n = 0;
+		} else {
+			k += parser_step(p, r == LZPI_DEC_INPUT, out + k);
+		}
+	} while (r == LZPI_DEC_OUTPUT);
+
+	if (UNLIKELY(!lzpi_dec_done(&d)))
+		ret = EIO;
+	else
+		ret = k < c ? flush(out, k, o) : flush(cmp, c, o);
+out:
+	lzpi_enc_free(e);
+	free(p);
+	free(out);
+	free(cmp);
+	if (UNLIKELY(ret))
+		errno = ret;
+	return ret;
+}
+
+/*
+ * the framed container, an opt-in alternative to the raw stream: a header
+ * of FRAME_MAGIC, FRAME_VERSION, the log2 of the block size and two zero
+ * bytes, then the blocks, each an independent raw stream of a block of
+ * input, then a trailer of the compressed length, raw length and crc32c of
+ * the compressed bytes of each block, the number of blocks, the crc32c of
+ * that table and FRAME_END, all integers 32-bit little endian
+ */
+#define FRAME_MAGIC "LZPF"
+#define FRAME_END "LZPT"
+#define FRAME_VERSION 1
+#define FRAME_SHIFT 20
+#define FRAME_HEADER 8
+#define FRAME_ENTRY 12
+#define FRAME_TRAILER 12
+
+/*
+ * the most threads coding the blocks of a frame
+ */
+#define FRAME_THREADS 64
+
+/*
+ * the size of a huge page, to which the buffers of a frame are rounded
+ */
+#define FRAME_HUGE ((size_t)1 << 21)
+
+/*
+ * the length of a buffer of a frame for n bytes, whole huge pages and at
+ * least one for the empty frame
+ */
+static size_t frame_round(size_t n)
+{
+	return n ? (n + FRAME_HUGE - 1) & ~(FRAME_HUGE - 1) : FRAME_HUGE;
+}
+
+/*
+ * allocate the untouched buffer of n bytes for the blocks of a frame, so
+ * that each page lands on the node of the thread that first writes to it,
+ * backed by explicit huge pages if there are any to spare or else by
+ * transparent ones
+ */
+static void *frame_alloc(size_t n)
+{
+	void *p;
+
+	n = frame_round(n);
+	p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED)
+		return p;
+	p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		 -1, 0);
+	if (UNLIKELY(p == MAP_FAILED))
+		return NULL;
+	madvise(p, n, MADV_HUGEPAGE);
+	return p;
+}
+
+/*
+ * free the buffer p of n bytes allocated by frame_alloc
+ */
+static void frame_free(void *p, size_t n)
+{
+	if (p)
+		munmap(p, frame_round(n));
+}
+
+/*
+ * the blocks of a frame f of n bytes, b of them, the entry of each in table
+ */
+struct frame {
+	const uint8_t *f;
+	size_t n;
+	size_t b;
+	const uint8_t *table;
+};
+
+/*
+ * check the header and trailer of the frame f of n bytes and open it as fr
+ */
+static int frame_open(struct frame *fr, const uint8_t *f, size_t n)
+{
+	size_t c = 0;
+
+	if (UNLIKELY(n < FRAME_HEADER + FRAME_TRAILER ||
+		     memcmp(f, FRAME_MAGIC, 4) || f[4] != FRAME_VERSION ||
+		     f[5] > 31 || memcmp(f + n - 4, FRAME_END, 4)))
+		return EILSEQ;
+
+	fr->f = f;
+	fr->n = n;
+	fr->b = le32_get(f + n - FRAME_TRAILER);
+	if (UNLIKELY(fr->b > (n - FRAME_HEADER - FRAME_TRAILER) / FRAME_ENTRY))
+		return EILSEQ;
+	fr->table = f + n - FRAME_TRAILER - fr->b * FRAME_ENTRY;
+	if (UNLIKELY(kern->crc(0, fr->table, fr->b * FRAME_ENTRY) !=
+		     le32_get(f + n - 8)))
+		return EILSEQ;
+
+	for (size_t j = 0; j != fr->b; ++j) {
+		c += le32_get(fr->table + j * FRAME_ENTRY);
+		if (UNLIKELY(le32_get(fr->table + j * FRAME_ENTRY + 4) >
+			     (uint32_t)1 << f[5]))
+			return EILSEQ;
+	}
+	return c == (size_t)(fr->table - f - FRAME_HEADER) ? 0 : EILSEQ;
+}
+
+/*
+ * the blocks of a frame for a thread to code with f, pinned to the cpu
+ * unless negative, or left where the scheduler puts it if that fails, and
+ * first reading their input from offset at of file fd unless negative
+ */
+struct frame_job {
+	int (*f)(struct lzpi_stream *s, size_t n);
+	struct lzpi_stream *s;
+	size_t n;
+	int cpu;
+	int fd;
+	off_t at;
+	int ret;
+};
+
+/*
+ * read the input of the blocks of j, which lie back to back in a buffer
+ * that nothing has touched yet, so that its pages land on the node of the
+ * thread reading them
+ */
+static int frame_read(const struct frame_job *j)
+{
+	uint8_t *const p = (uint8_t *)j->s->in;
+	const size_t n = (size_t)(j->s[j->n - 1].in - j->s->in) +
+			 j->s[j->n - 1].n;
+
+	for (size_t k = 0; k != n;) {
+		const ssize_t r = pread(j->fd, p + k, n - k, j->at + (off_t)k);
+
+		if (UNLIKELY(r <= 0)) {
+			if (r && errno == EINTR)
+				continue;
+			/* the file shrank while it was read */
+			return r ? errno : EIO;
+		}
+		k += (size_t)r;
+	}
+	return 0;
+}
+
+static void *frame_run(void *a)
+{
+	struct frame_job *j = a;
+
+	if (j->cpu >= 0) {
+		cpu_set_t c;
+
+		CPU_ZERO(&c);
+		CPU_SET(j->cpu, &c);
+		pthread_setaffinity_np(pthread_self(), sizeof c, &c);
+	}
+	if (j->fd < 0 || LIKELY(!(j->ret = frame_read(j))))
+		j->ret = j->f(j->s, j->n);
+	return NULL;
+}
+
+/*
+ * the threads coding a frame, or 0 for a thread per cpu
+ */
+static size_t frame_threads;
+
+/*
+ * code the n streams s with f, shared out between frame_threads threads or
+ * a thread per cpu of the affinity mask of this one, or per online cpu if
+ * that is unknown, each pinned to a cpu of the mask in turn while there are
+ * enough to go around, and return the first error; unless fd is negative,
+ * each thread first reads the input of its share from file fd, in which
+ * s->in lies at offset at
+ */
+static int frame_parallel(int (*f)(struct lzpi_stream *s, size_t n),
+			  struct lzpi_stream *s, size_t n, int fd, off_t at)
+{
+	struct frame_job j[FRAME_THREADS];
+	pthread_t th[FRAME_THREADS];
+	int up[FRAME_THREADS];
+	cpu_set_t own;
+	/* taskset and cpusets leave fewer cpus than are online */
+	const int mask = !pthread_getaffinity_np(pthread_self(), sizeof own,
+						 &own);
+	const long c = mask ? CPU_COUNT(&own) : sysconf(_SC_NPROCESSORS_ONLN);
+	size_t t = frame_threads ? frame_threads : c < 1 ? 1 : (size_t)c;
+	int ret = 0, pin, cpu = -1;
+
+	if (t > FRAME_THREADS)
+		t = FRAME_THREADS;
+	if (t > n)
+		t = n;
+	pin = t > 1 && mask && (size_t)CPU_COUNT(&own) >= t;
+
+	for (size_t k = 0; k != t; ++k) {
+		const size_t o = n * k / t;
+
+		/* the k-th cpu this thread may run on */
+		if (pin)
+			while (!CPU_ISSET(++cpu, &own))
+				;
+		j[k] = (struct frame_job){ f,
+					   s + o,
+					   n * (k + 1) / t - o,
+					   pin ? cpu : -1,
+					   fd,
+					   at + (off_t)(s[o].in - s->in),
+					   0 };
+	}
+	/* code the share of any thread that cannot start on this one */
+	for (size_t k = 1; k < t; ++k)
+		if (UNLIKELY(!(up[k] = !pthread_create(&th[k], NULL, frame_run,
+							&j[k]))))
+			frame_run(&j[k]);
+	if (LIKELY(t))
+		frame_run(&j[0]);
+	for (size_t k = 0; k != t; ++k) {
+		if (k && up[k])
+			pthread_join(th[k], NULL);
+		if (!ret)
+			ret = j[k].ret;
+	}
+	/* this thread ran the share of any other on its cpu, so unpin it */
+	if (pin)
+		pthread_setaffinity_np(pthread_self(), sizeof own, &own);
+	return ret;
+}
+
+/*
+ * compress file i to file o until EOF as a frame, coding its blocks in
+ * parallel, each thread reading its own blocks of i if it is a regular file
+ * and so placing them on its node, or else all of i read up front
+ */
+static int compress_framed(FILE *i, FILE *o)
+{
+	const size_t z = (size_t)1 << FRAME_SHIFT;
+	/* every group of eight raw bytes costs one control byte */
+	const size_t cap = z + z / CHAR_BIT + 1;
+	uint8_t h[FRAME_HEADER] = FRAME_MAGIC;
+	struct lzpi_stream *s = NULL;
+	uint8_t *src = NULL, *out = NULL, *table = NULL;
+	struct stat st;
+	off_t at = 0;
+	const int known = !fstat(fileno(i), &st) && S_ISREG(st.st_mode) &&
+			  (at = lseek(fileno(i), 0, SEEK_CUR)) >= 0 &&
+			  st.st_size >= at &&
+			  (uintmax_t)(st.st_size - at) <= SIZE_MAX;
+	const int fd = known ? fileno(i) : -1;
+	size_t n, b;
+	int ret;
+
+	if (known)
+		n = (size_t)(st.st_size - at);
+	else if (UNLIKELY(ret = slurp(i, &src, &n)))
+		return ret;
+	b = (n + z - 1) >> FRAME_SHIFT;
+	if (UNLIKELY(b > UINT32_MAX || !(s = calloc(b + 1, sizeof *s)) ||
+		     (known && !(src = frame_alloc(n))) ||
+		     !(out = frame_alloc(b * cap)) ||
+		     !(table = malloc(b * FRAME_ENTRY + FRAME_TRAILER)))) {
+		ret = ENOMEM;
+		goto out;
+	}
+
+	for (size_t j = 0; j != b; ++j) {
+		s[j].in = src + j * z;
+		s[j].n = j + 1 == b ? n - j * z : z;
+		s[j].out = out + j * cap;
+		s[j].cap = cap;
+	}
+	if (UNLIKELY(ret = frame_parallel(lzpi_compress_batch, s, b, fd, at)))
+		goto out;
+	/* leave i past what was read, as slurp does */
+	if (known && UNLIKELY(lseek(fd, at + (off_t)n, SEEK_SET) < 0)) {
+		ret = errno;
+		goto out;
+	}
+
+	h[4] = FRAME_VERSION;
+	h[5] = FRAME_SHIFT;
+	if (UNLIKELY(ret = flush(h, sizeof h, o)))
+		goto out;
+	for (size_t j = 0; j != b; ++j) {
+		uint8_t *e = table + j * FRAME_ENTRY;
+
+		le32_put(e, (uint32_t)s[j].len);
+		le32_put(e + 4, (uint32_t)s[j].n);
+		le32_put(e + 8, kern->crc(0, s[j].out, s[j].len));
+		if (UNLIKELY(ret = flush(s[j].out, s[j].len, o)))
+			goto out;
+	}
+	le32_put(table + b * FRAME_ENTRY, (uint32_t)b);
+	le32_put(table + b * FRAME_ENTRY + 4,
+	      kern->crc(0, table, b * FRAME_ENTRY));
+	memcpy(table + b * FRAME_ENTRY + 8, FRAME_END, 4);
+	ret = flush(table, b * FRAME_ENTRY + FRAME_TRAILER, o);
+out:
+	free(table);
+	frame_free(out, b * cap);
+	free(s);
+	if (known)
+		frame_free(src, n);
+	else
+		free(src);
+	if (UNLIKELY(ret))
+		errno = ret;
+	return ret;
+}
+
+/*
+ * decompress the frame of file i to file o, checking every block before
+ * decoding them all in parallel into the output preallocated from the table
+ */
+static int decompress_framed(FILE *i, FILE *o)
+{
+	struct lzpi_stream *s = NULL;
+	uint8_t *f, *out = NULL;
+	struct frame fr;
+	size_t n, c = FRAME_HEADER, u = 0, k = 0;
+	int ret;
+
+	if (UNLIKELY(ret = slurp(i, &f, &n)))
+		return ret;
+	if (UNLIKELY(ret = frame_open(&fr, f, n)))
+		goto out;
+	for (size_t j = 0; j != fr.b; ++j)
+		u += le32_get(fr.table + j * FRAME_ENTRY + 4);
+	if (UNLIKELY(!(s = calloc(fr.b + 1, sizeof *s)) ||
+		     !(out = frame_alloc(u)))) {
+		ret = ENOMEM;
+		goto out;
+	}
+
+	for (size_t j = 0; j != fr.b; ++j) {
+		const uint8_t *e = fr.table + j * FRAME_ENTRY;
+
+		s[j].in = f + c;
+		s[j].n = le32_get(e);
+		s[j].out = out + k;
+		s[j].cap = le32_get(e + 4);
+		if (UNLIKELY(kern->crc(0, s[j].in, s[j].n) != le32_get(e + 8))) {
+			ret = EILSEQ;
+			goto out;
+		}
+		c += s[j].n;
+		k += s[j].cap;
+	}
+	if (UNLIKELY(ret = frame_parallel(lzpi_decompress_batch, s, fr.b, -1,
+					  0)))
+		goto out;
+	for (size_t j = 0; j != fr.b; ++j)
+		if (UNLIKELY(s[j].len != s[j].cap)) {
+			ret = EIO;
+			goto out;
+		}
+	ret = flush(out, u, o);
+out:
+	frame_free(out, u);
+	free(s);
+	free(f);
+	if (UNLIKELY(ret))
+		errno = ret;
+	return ret;
+}
+
+/*
+ * copy block k of the frame of file i to file o as the raw stream the pi
+ * reads, checking it first
+ */
+static int raw_block(FILE *i, FILE *o, size_t k)
+{
+	struct frame fr;
+	uint8_t *f;
+	size_t n, c = FRAME_HEADER;
+	int ret;
+
+	if (UNLIKELY(ret = slurp(i, &f, &n)))
+		return ret;
+	if (UNLIKELY(ret = frame_open(&fr, f, n)))
+		goto out;
+	if (UNLIKELY(k >= fr.b)) {
+		ret = EINVAL;
+		goto out;
+	}
+	for (size_t j = 0; j != k; ++j)
+		c += le32_get(fr.table + j * FRAME_ENTRY);
+	n = le32_get(fr.table + k * FRAME_ENTRY);
+	if (UNLIKELY(kern->crc(0, f + c, n) !=
+		     le32_get(fr.table + k * FRAME_ENTRY + 8))) {
+		ret = EILSEQ;
+		goto out;
+	}
+	ret = flush(f + c, n, o);
+out:
+	free(f);
+	if (UNLIKELY(ret))
+		errno = ret;
+	return ret;
+}
+
+/*
+ * compress file i to file o until EOF as a sized stream, recording the
+ * length up front if i is a regular file, or else after the stream
+ */
+static int compress_sized(FILE *i, FILE *o)
+{
+	uint8_t h[SIZED_HEADER] = SIZED_MAGIC;
+	struct stat st;
+	off_t at = 0;
+	const int known = !fstat(fileno(i), &st) && S_ISREG(st.st_mode) &&
+			  (at = lseek(fileno(i), 0, SEEK_CUR)) >= 0 &&
+			  st.st_size >= at;
+	size_t n;
+	int ret;
+
+	h[4] = known ? 0 : SIZED_TAIL;
+	le64_put(h + 5, known ? (uint64_t)(st.st_size - at) : 0);
+	if (UNLIKELY((ret = flush(h, sizeof h, o)) ||
+		     (ret = compress_len(i, o, &n, NULL, NULL))))
+		return ret;
+	if (known) {
+		/* the file changed size while it was read */
+		if (UNLIKELY((uint64_t)n != le64_get(h + 5)))
+			return errno = EIO;
+		return 0;
+	}
+	le64_put(h, n);
+	return flush(h, SIZED_FOOTER, o);
+}
+
+/*
+ * map file i into *bf of length *n if it is a regular file read from its
+ * start, setting *m, or else read all of it
+ */
+static int input_map(FILE *i, uint8_t **bf, size_t *n, int *m)
+{
+	struct stat st;
+	void *p;
+
+	*m = 0;
+	if (fstat(fileno(i), &st) || !S_ISREG(st.st_mode) || !st.st_size ||
+	    lseek(fileno(i), 0, SEEK_CUR) ||
+	    (uintmax_t)st.st_size > SIZE_MAX ||
+	    (p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+		      fileno(i), 0)) == MAP_FAILED)
+		return slurp(i, bf, n);
+	*bf = p;
+	*n = (size_t)st.st_size;
+	*m = 1;
+	return 0;
+}
+
+/*
+ * allocate the n bytes of file o at once and map them into *bf if it is a
+ * regular file open for reading and writing from its start, setting *m, or
+ * else allocate *bf
+ */
+static int output_map(FILE *o, size_t n, uint8_t **bf, int *m)
+{
+	const int fd = fileno(o);
+	struct stat st;
+	void *p;
+
+	*m = 0;
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && n &&
+	    (fcntl(fd, F_GETFL) & O_ACCMODE) == O_RDWR &&
+	    !lseek(fd, 0, SEEK_CUR) && (uintmax_t)n <= INTMAX_MAX &&
+	    !ftruncate(fd, (off_t)n) &&
+	    /* reserve the blocks too where the file system can */
+	    (posix_fallocate(fd, 0, (off_t)n), 1) &&
+	    (p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) !=
+		    MAP_FAILED) {
+		*bf = p;
+		*m = 1;
+		return 0;
+	}
+	return (*bf = malloc(n + 1)) ? 0 : ENOMEM;
+}
+
+/*
+ * decompress the sized stream of file i to file o, mapping both where they
+ * are regular files and decoding straight into the output allocated once
+ * for its recorded length, which a truncated stream falls short of
+ */
+static int decompress_sized(FILE *i, FILE *o)
+{
+	struct lzpi_stream s;
+	uint8_t *in, *out = NULL;
+	size_t n;
+	int mi, mo = 0, ret;
+
+	if (UNLIKELY(ret = input_map(i, &in, &n, &mi)))
+		return ret;
+	if (UNLIKELY((ret = lzpi_sized_open(in, n, &s)) ||
+		     (ret = output_map(o, s.cap, &out, &mo))))
+		goto out;
+	s.out = out;
+	ret = lzpi_decompress_batch(&s, 1);
+	if (!ret && UNLIKELY(s.len != s.cap))
+		ret = EIO;
+
+	/* keep the output decoded so far, as for a raw stream */
+	if (mo) {
+		munmap(out, s.cap);
+		if (UNLIKELY(s.len != s.cap) &&
+		    UNLIKELY(ftruncate(fileno(o), (off_t)s.len)) && !ret)
+			ret = errno;
+		if (LIKELY(!ret) && UNLIKELY(lseek(fileno(o), 0, SEEK_END) < 0))
+			ret = errno;
+	} else {
+		const int err = flush(out, s.len, o);
+
+		if (!ret)
+			ret = err;
+		free(out);
+	}
+out:
+	if (mi)
+		munmap(in, n);
+	else
+		free(in);
+	if (UNLIKELY(ret))
+		errno = ret;
+	return ret;
+}
+
+/*
+ * the size of the blocks of direct i/o and the alignment of their buffers,
+ * offsets and lengths, a multiple of the logical block size of any device
+ */
+#define DIRECT_SIZE ((size_t)1 << 20)
+#define DIRECT_ALIGN ((size_t)1 << 12)
+static_assert(!(DIRECT_SIZE % DIRECT_ALIGN), "invalid DIRECT_SIZE");
+
+/*
+ * a stream of direct i/o on the regular file fd with the status flags fl
+ * through the buffer bf, holding n bytes of which p have been read, at the
+ * offset at of the file, which bypasses the page cache with O_DIRECT if od
+ * is set, or else drops the pages behind it, until the end of the file if
+ * eof is set
+ */
+struct direct {
+	int fd;
+	int fl;
+	int od;
+	int eof;
+	uint8_t *bf;
+	size_t n;
+	size_t p;
+	off_t at;
+};
+
+/*
+ * stop bypassing the page cache for d, as a file system may refuse O_DIRECT
+ * only once it is used
+ */
+static int direct_cached(struct direct *d)
+{
+	const int fl = fcntl(d->fd, F_GETFL);
+
+	if (UNLIKELY(fl < 0 || fcntl(d->fd, F_SETFL, fl & ~O_DIRECT)))
+		return -1;
+	d->od = 0;
+	return 0;
+}
+
+/*
+ * drop the pages of d in [at, at + n) from the page cache, once they have
+ * been written back if the file is written, where n = 0 reaches to its end
+ */
+static void direct_drop(const struct direct *d, off_t at, off_t n, int w)
+{
+	if (w)
+		sync_file_range(d->fd, at, n,
+				SYNC_FILE_RANGE_WAIT_BEFORE |
+					SYNC_FILE_RANGE_WRITE |
+					SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise(d->fd, at, n, POSIX_FADV_DONTNEED);
+}
+
+/*
+ * the offset of the block before offset at
+ */
+static inline off_t direct_behind(off_t at)
+{
+	return at >= (off_t)DIRECT_SIZE ? at - (off_t)DIRECT_SIZE : 0;
+}
+
+static ssize_t direct_read(void *c, char *b, size_t n)
+{
+	struct direct *d = c;
+
+	if (d->p == d->n && !d->eof) {
+		ssize_t r;
+
+		d->at += (off_t)d->n;
+		d->n = d->p = 0;
+		while ((r = read(d->fd, d->bf, DIRECT_SIZE)) < 0)
+			if (errno != EINTR &&
+			    (errno != EINVAL || !d->od || direct_cached(d)))
+				return -1;
+		/* with the last block, in case readahead held on to it */
+		if (!d->od)
+			direct_drop(d, direct_behind(d->at),
+				    d->at + r - direct_behind(d->at), 0);
+		/* the tail leaves the offset unaligned for O_DIRECT */
+		d->eof = (size_t)r != DIRECT_SIZE;
+		d->n = (size_t)r;
+	}
+	if (n > d->n - d->p)
+		n = d->n - d->p;
+	memcpy(b, d->bf + d->p, n);
+	d->p += n;
+	return (ssize_t)n;
+}
+
+/*
+ * write bf[0:n] of d to its file, dropping what is written behind it
+ * unless O_DIRECT bypasses the page cache
+ */
+static int direct_put(struct direct *d, size_t n)
+{
+	for (size_t k = 0; k != n;) {
+		const ssize_t r = write(d->fd, d->bf + k, n - k);
+
+		if (r >= 0)
+			k += (size_t)r;
+		else if (errno != EINTR &&
+			 (errno != EINVAL || !d->od || k || direct_cached(d)))
+			return -1;
+	}
+	if (!d->od) {
+		/* start writing back this block and wait for the last one */
+		sync_file_range(d->fd, d->at, (off_t)n, SYNC_FILE_RANGE_WRITE);
+		if (d->at >= (off_t)DIRECT_SIZE)
+			direct_drop(d, direct_behind(d->at), (off_t)DIRECT_SIZE,
+				    1);
+	}
+	d->at += (off_t)n;
+	return 0;
+}
+
+static ssize_t direct_write(void *c, const char *b, size_t n)
+{
+	struct direct *d = c;
+	const size_t u = n < DIRECT_SIZE - d->n ? n : DIRECT_SIZE - d->n;
+
+	memcpy(d->bf + d->n, b, u);
+	if ((d->n += u) == DIRECT_SIZE) {
+		if (UNLIKELY(direct_put(d, DIRECT_SIZE)))
+			return -1;
+		d->n = 0;
+	}
+	return (ssize_t)u;
+}
+
+/*
+ * restore the status flags of the file of d and free it
+ */
+static void direct_free(struct direct *d)
+{
+	fcntl(d->fd, F_SETFL, d->fl);
+	free(d->bf);
+	free(d);
+}
+
+/*
+ * close a stream of direct i/o opened for reading, which leaves the file
+ * as it is
+ */
+static int direct_close_read(void *c)
+{
+	struct direct *d = c;
+
+	/* whatever readahead left behind */
+	direct_drop(d, direct_behind(d->at), 0, 0);
+	direct_free(d);
+	return 0;
+}
+
+static int direct_close(void *c)
+{
+	struct direct *d = c;
+	const off_t at = d->at;
+	int ret = 0;
+
+	if (d->n) {
+		/* O_DIRECT writes whole blocks, the tail goes through the cache */
+		const size_t a = d->od ? d->n & ~(DIRECT_ALIGN - 1) : 0;
+
+		if (UNLIKELY(a && direct_put(d, a)) ||
+		    UNLIKELY(d->od && direct_cached(d)) ||
+		    (memmove(d->bf, d->bf + a, d->n - a),
+		     UNLIKELY(d->n != a && direct_put(d, d->n - a))))
+			ret = -1;
+	}
+	/* the tail and whatever readahead left behind */
+	direct_drop(d, direct_behind(at), 0, 1);
+	direct_free(d);
+	return ret;
+}
+
+/*
+ * open a stream *s of direct i/o for reading or writing, as w, the regular
+ * file f from its position on, or else leave *s NULL to use f as it is
+ */
+static int direct_open(FILE *f, int w, FILE **s)
+{
+	const cookie_io_functions_t ro = { .read = direct_read,
+					   .close = direct_close_read };
+	const cookie_io_functions_t wo = { .write = direct_write,
+					   .close = direct_close };
+	const int fd = fileno(f), fl = fcntl(fd, F_GETFL);
+	struct direct *d;
+	struct stat st;
+	off_t at;
+	void *p;
+
+	*s = NULL;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || fl < 0 ||
+	    (at = lseek(fd, 0, SEEK_CUR)) < 0)
+		return 0;
+	if (UNLIKELY(!(d = malloc(sizeof *d))))
+		return ENOMEM;
+	if (UNLIKELY(posix_memalign(&p, DIRECT_ALIGN, DIRECT_SIZE))) {
+		free(d);
+		return ENOMEM;
+	}
+	*d = (struct direct){ .fd = fd, .fl = fl, .bf = p, .at = at };
+
+	/* appending moves the offset, and a file system may refuse O_DIRECT */
+	d->od = !(at & (off_t)(DIRECT_ALIGN - 1)) && !(fl & O_APPEND) &&
+		!fcntl(fd, F_SETFL, fl | O_DIRECT);
+	if (!d->od && !w)
+		posix_fadvise(fd, at, 0, POSIX_FADV_SEQUENTIAL);
+	if (UNLIKELY(!(*s = fopencookie(d, w ? "w" : "r", w ? wo : ro)))) {
+		fcntl(fd, F_SETFL, fl);
+		free(p);
+		free(d);
+		return ENOMEM;
+	}
+	return 0;
+}
+
+/*
+ * run the coder c from file i to file o, each through a stream of direct
+ * i/o where it is a regular file
+ */
+static int direct(FILE *i, FILE *o, int (*c)(FILE *, FILE *))
+{
+	FILE *si, *so = NULL;
+	int ret;
+
+	if (UNLIKELY((ret = direct_open(i, 0, &si)) ||
+		     (ret = direct_open(o, 1, &so))))
+		goto out;
+	ret = c(si ? si : i, so ? so : o);
+out:
+	if (so && UNLIKELY(fclose(so)) && !ret)
+		ret = errno ? errno : EIO;
+	if (si && UNLIKELY(fclose(si)) && !ret)
+		ret = errno ? errno : EIO;
+	if (UNLIKELY(ret))
+		errno = ret;
+	return ret;
+}
+
+/*
+ * show usage information and return an error
+ */
+static int usage(const char *restrict name)
+{
+	fprintf(stderr,
+		"Usage:\t\t%s [-d | --decompress | -r | --recompress [level] |"
+		"\n\t\t    --verify]"
+		"\n\t\t%s --direct [-d | --decompress]"
+		"\n\t\t%s -f | --framed | -s | --sized | --lzss"
+		"\n\t\t    [-d | --decompress]\n\t\t"
+		"%s --raw-block n"
+		"\n\t\t%s [--budget-ms ms] [--min-mbps rate]"
+		"\n\nExample:\t"
+		"tar -c archive | %s >archive.tar.lzpi\n\t\t"
+		"%s <archive.tar.lzpi | tar -x\n\t\t"
+		"%s -d <archive.tar.lzpi >archive.tar\n\t\t"
+		"%s -r 2 <archive.tar.lzpi >smaller.tar.lzpi\n\t\t"
+		"%s -f <image.bin >image.lzpf\n\t\t"
+		"%s --raw-block 0 <image.lzpf >pieeprom.lzpi\n\t\t"
+		"%s --budget-ms 500 <image.bin >image.lzpi\n",
+		name, name, name, name, name, name, name, name, name, name, name,
+		name);
+	return 1;
+}
+
+/*
+ * match -d or --decompress for the decompression flag
+ */
+static inline int match_decompress(const char *s)
+{
+	return !strcmp(s, "-d") || !strcmp(s, "--decompress");
+}
+
+/*
+ * match -r or --recompress for the recompression flag
+ */
+static inline int match_recompress(const char *s)
+{
+	return !strcmp(s, "-r") || !strcmp(s, "--recompress");
+}
+
+/*
+ * match --direct for the direct i/o flag
+ */
+static inline int match_direct(const char *s)
+{
+	return !strcmp(s, "--direct");
+}
+
+/*
+ * match --verify for the verification flag
+ */
+static inline int match_verify(const char *s)
+{
+	return !strcmp(s, "--verify");
+}
+
+/*
+ * match -f or --framed for the framed container flag
+ */
+static inline int match_framed(const char *s)
+{
+	return !strcmp(s, "-f") || !strcmp(s, "--framed");
+}
+
+/*
+ * match -s or --sized for the sized stream flag
+ */
+static inline int match_sized(const char *s)
+{
+	return !strcmp(s, "-s") || !strcmp(s, "--sized");
+}
+
+/*
+ * match --lzss for the 4 KiB lzss flag
+ */
+static inline int match_lzss(const char *s)
+{
+	return !strcmp(s, "--lzss");
+}
+
+/*
+ * match --raw-block for the raw block flag
+ */
+static inline int match_raw_block(const char *s)
+{
+	return !strcmp(s, "--raw-block");
+}
+
+/*
+ * match a block number, storing it in k
+ */
+static inline int match_block(const char *s, size_t *k)
+{
+	char *e;
+	unsigned long long v;
+
+	if (UNLIKELY(*s < '0' || *s > '9'))
+		return 0;
+	errno = 0;
+	v = strtoull(s, &e, 10);
+	if (UNLIKELY(*e || errno || v > SIZE_MAX))
+		return 0;
+	*k = (size_t)v;
+	return 1;
+}
+
+/*
+ * match --budget-ms or --min-mbps and a positive number v for them, storing
+ * it in *ms or *mbps
+ */
+static inline int match_budget(const char *s, const char *v, double *ms,
+			       double *mbps)
+{
+	double *const d = !strcmp(s, "--budget-ms") ? ms :
+			  !strcmp(s, "--min-mbps")  ? mbps :
+						      NULL;
+	char *e;
+
+	if (UNLIKELY(!d || *v < '0' || *v > '9'))
+		return 0;
+	errno = 0;
+	*d = strtod(v, &e);
+	return !*e && !errno && *d > 0;
+}
+
+/*
+ * match a level of recompression from 1 to LEVEL_MAX, storing it in l
+ */
+static inline int match_level(const char *s, enum level *l)
+{
+	if (UNLIKELY(s[0] < '1' || s[0] > '0' + LEVEL_MAX || s[1]))
+		return 0;
+	*l = (enum level)(s[0] - '0');
+	return 1;
+}
+
+/*
+ * lzpi
+ * accepts an optional -d or --decompress flag for choosing decompression mode
+ * or -r or --recompress with an optional level, 1 for the parser of the
+ * compressor and LEVEL_MAX, the default, for the one producing the fewest
+ * bytes, for recompressing a stream
+ * -f or --framed, optionally with -d or --decompress, for the framed
+ * container instead, -s or --sized likewise for the sized stream, --lzss
+ * likewise for the lzss format with a 4 KiB window, or --raw-block and a block number for extracting that
+ * block of a frame as a raw stream
+ * --budget-ms and a time in ms, --min-mbps and a rate in MB/s or both for
+ * compressing within that, reporting the effort achieved
+ * reads a file from stdin and writes the processed output to stdout
+ * returns errno on error
+ */
+int main(int argc, char **argv)
+{
+	int ret;
+	const char *name = strrchr(argv[0], '/') + 1;
+	enum level l = LEVEL_MAX;
+	double ms = 0, mbps = 0;
+	struct budget bg;
+	size_t b;
+
+	if (name == (const char *)1)
+		name = argv[0];
+
+	switch (argc) {
+	case 1:
+		if (UNLIKELY(ret = compress(stdin, stdout)))
+			perror(name);
+		break;
+	case 2:
+		if (LIKELY(match_decompress(argv[1]))) {
+			if (UNLIKELY(ret = decompress(stdin, stdout)))
+				perror(name);
+			break;
+		}
+		if (match_framed(argv[1])) {
+			if (UNLIKELY(ret = compress_framed(stdin, stdout)))
+				perror(name);
+			break;
+		}
+		if (match_sized(argv[1])) {
+			if (UNLIKELY(ret = compress_sized(stdin, stdout)))
+				perror(name);
+			break;
+		}
+		if (match_lzss(argv[1])) {
+			if (UNLIKELY(ret = lzss_4k_compress(stdin, stdout)))
+				perror(name);
+			break;
+		}
+		if (match_direct(argv[1])) {
+			if (UNLIKELY(ret = direct(stdin, stdout, compress)))
+				perror(name);
+			break;
+		}
+		if (match_verify(argv[1])) {
+			if (UNLIKELY(ret = compress_verified(stdin, stdout)))
+				perror(name);
+			break;
+		} /* fallthrough */
+	case 3:
+		if (match_recompress(argv[1]) &&
+		    (argc == 2 || match_level(argv[2], &l))) {
+			if (UNLIKELY(ret = recompress(stdin, stdout, l)))
+				perror(name);
+			break;
+		}
+		if (argc == 3 &&
+		    ((match_framed(argv[1]) && match_decompress(argv[2])) ||
+		     (match_decompress(argv[1]) && match_framed(argv[2])))) {
+			if (UNLIKELY(ret = decompress_framed(stdin, stdout)))
+				perror(name);
+			break;
+		}
+		if (argc == 3 &&
+		    ((match_sized(argv[1]) && match_decompress(argv[2])) ||
+		     (match_decompress(argv[1]) && match_sized(argv[2])))) {
+			if (UNLIKELY(ret = decompress_sized(stdin, stdout)))
+				perror(name);
+			break;
+		}
+		if (argc == 3 &&
+		    ((match_lzss(argv[1]) && match_decompress(argv[2])) ||
+		     (match_decompress(argv[1]) && match_lzss(argv[2])))) {
+			if (UNLIKELY(ret = lzss_4k_decompress(stdin, stdout)))
+				perror(name);
+			break;
+		}
+		if (argc == 3 &&
+		    ((match_direct(argv[1]) && match_decompress(argv[2])) ||
+		     (match_decompress(argv[1]) && match_direct(argv[2])))) {
+			if (UNLIKELY(ret = direct(stdin, stdout, decompress)))
+				perror(name);
+			break;
+		}
+		if (argc == 3 && match_raw_block(argv[1]) &&
+		    match_block(argv[2], &b)) {
+			if (UNLIKELY(ret = raw_block(stdin, stdout, b)))
+				perror(name);
+			break;
+		} /* fallthrough */
+	case 5:
+		if ((argc == 3 || argc == 5) &&
+		    match_budget(argv[1], argv[2], &ms, &mbps) &&
+		    (argc == 3 || match_budget(argv[3], argv[4], &ms, &mbps))) {
+			budget_init(&bg, ms, 0, mbps);
+			if (UNLIKELY(ret = compress_budget(stdin, stdout, &bg)))
+				perror(name);
+			else
+				budget_report(&bg, name);
+			break;
+		} /* fallthrough */
+	default:
+		ret = usage(name);
+	}
+	return ret;
+}
+#endif
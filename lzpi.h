@@ -0,0 +1,216 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LZPI_H
+#define LZPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * a stream of a batch, reading the input in[0:n] and writing to the output
+ * buffer out[0:cap], which receives the length len of the output and an
+ * errno value err, 0 on success
+ */
+struct lzpi_stream {
+	const uint8_t *in;
+	size_t n;
+	uint8_t *out;
+	size_t cap;
+	size_t len;
+	int err;
+};
+
+/*
+ * compress each of the n independent streams s exactly like the compressor
+ * of lzpi, searching several of them in lockstep on the calling thread, and
+ * return 0 or the error of the first stream that failed
+ * a stream fails with ENOBUFS if its output does not fit, keeping the output
+ * encoded up to there
+ */
+int lzpi_compress_batch(struct lzpi_stream *s, size_t n);
+
+/*
+ * decompress each of the n independent streams s, interleaving several of
+ * them on the calling thread, and return 0 or the error of the first stream
+ * that failed
+ * a stream fails with EIO if its input is truncated and with ENOBUFS if its
+ * output does not fit, keeping the output decoded up to there
+ */
+int lzpi_decompress_batch(struct lzpi_stream *s, size_t n);
+
+struct iovec;
+
+/*
+ * compress the input spread over the ni buffers in as one stream, exactly
+ * like the compressor of lzpi, to the no buffers out, filling each in turn,
+ * storing the length of the output in *len, and return 0 or ENOBUFS if the
+ * output does not fit, keeping the output up to there
+ */
+int lzpi_compressv(const struct iovec *in, size_t ni, const struct iovec *out,
+		   size_t no, size_t *len);
+
+/*
+ * decompress the stream spread over the ni buffers in to the no buffers
+ * out like lzpi_compressv, and return 0, EIO if the stream is truncated or
+ * ENOBUFS if the output does not fit, keeping the output up to there
+ */
+int lzpi_decompressv(const struct iovec *in, size_t ni,
+		     const struct iovec *out, size_t no, size_t *len);
+
+/*
+ * open the sized stream in[0:n], written by lzpi --sized, as the raw stream
+ * s it wraps with its raw length in s->cap, ready for lzpi_decompress_batch
+ * once s->out has room for that, and return 0 or EILSEQ if it is no sized
+ * stream or its raw stream cannot decode to that length
+ */
+int lzpi_sized_open(const uint8_t *in, size_t n, struct lzpi_stream *s);
+
+/*
+ * a job for lzpi_submit, coding the stream s with lzpi_decompress_batch if
+ * decompress is set or else with lzpi_compress_batch, then handed to the
+ * callback done with the result in s.err, where arg is free for the caller
+ * and next is private
+ */
+struct lzpi_job {
+	struct lzpi_stream s;
+	int decompress;
+	void (*done)(struct lzpi_job *j);
+	void *arg;
+	struct lzpi_job *next;
+};
+
+/*
+ * start the pool shared by all jobs with the given number of threads and
+ * room for depth jobs in flight, 0 choosing a thread per cpu and a depth to
+ * match, and return 0, EBUSY if it is running or stopping or the error
+ * that stopped it
+ * lzpi_submit and lzpi_pool_fd start it with both 0 if it is not running
+ */
+int lzpi_pool_start(unsigned threads, size_t depth);
+
+/*
+ * queue the job j for the pool, which calls done(j) from lzpi_reap once it
+ * is finished, and return 0, EAGAIN while the pool holds as many jobs as
+ * its depth, counting those finished but not yet reaped, or ESHUTDOWN while
+ * lzpi_pool_stop is stopping it
+ * j must stay valid until done is called
+ */
+int lzpi_submit(struct lzpi_job *j, void (*done)(struct lzpi_job *j));
+
+/*
+ * the eventfd of the pool, readable once a job has finished, for epoll or
+ * poll, or -1 with errno set if the pool cannot start, ESHUTDOWN while
+ * lzpi_pool_stop is stopping it
+ */
+int lzpi_pool_fd(void);
+
+/*
+ * call done for every finished job on the calling thread, in the order
+ * they finished, and return how many there were
+ */
+size_t lzpi_reap(void);
+
+/*
+ * finish every job submitted, reap them and stop the pool, refusing new
+ * jobs meanwhile; a call while another is stopping the pool waits for that
+ * one to return instead, and the next job submitted starts it again
+ * not to be called from done
+ */
+void lzpi_pool_stop(void);
+
+/*
+ * the state of a compressor between calls, which writes the same stream as
+ * lzpi however its input and output are split
+ */
+struct lzpi_enc;
+
+/*
+ * a new compressor at the start of a stream, or NULL with errno set
+ */
+struct lzpi_enc *lzpi_enc_new(void);
+
+/*
+ * free the compressor e
+ */
+void lzpi_enc_free(struct lzpi_enc *e);
+
+/*
+ * compress the input in[0:*ni] to the output out[0:*no] with e, storing the
+ * bytes consumed and produced in *ni and *no, and return LZPI_DEC_INPUT once
+ * the input runs out or LZPI_DEC_OUTPUT once the output is full, like
+ * lzpi_dec, or 0 once end is set, the input consumed and the stream written
+ * input is buffered until it fills the window or end marks the last of it
+ */
+int lzpi_enc(struct lzpi_enc *e, const uint8_t *in, size_t *ni, uint8_t *out,
+	     size_t *no, int end);
+
+/*
+ * the state of the freestanding decoder of core.c between calls, which
+ * keeps the last 256 bytes of output in h, the oldest at h[p], the control
+ * byte of the group in map above a sentinel bit, the distance o of a match
+ * whose length byte is pending if s is set, and the r bytes of the match
+ * left to write
+ */
+struct lzpi_dec {
+	uint8_t h[256];
+	uint8_t p;
+	uint8_t o;
+	uint8_t s;
+	uint16_t map;
+	uint16_t r;
+};
+
+/*
+ * what lzpi_dec needs to continue
+ */
+enum { LZPI_DEC_INPUT = 1, LZPI_DEC_OUTPUT };
+
+/*
+ * start decoding a stream with d
+ */
+void lzpi_dec_init(struct lzpi_dec *d);
+
+/*
+ * decode the input in[0:*ni] to the output out[0:*no] with d, storing the
+ * bytes consumed and produced in *ni and *no, and return LZPI_DEC_INPUT
+ * once the input runs out or LZPI_DEC_OUTPUT once the output is full
+ * neither span needs to follow the one of the previous call
+ */
+int lzpi_dec(struct lzpi_dec *d, const uint8_t *in, size_t *ni, uint8_t *out,
+	     size_t *no);
+
+/*
+ * whether the input consumed by d so far forms a whole stream, rather than
+ * one truncated within a token
+ */
+int lzpi_dec_done(const struct lzpi_dec *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
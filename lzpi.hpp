@@ -0,0 +1,762 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * the c++17 interface to the codec over lzpi.h, as raii coders, streambufs
+ * and, with c++20, helpers on spans, throwing std::system_error with the
+ * errno value of a failure
+ */
+
+#ifndef LZPI_HPP
+#define LZPI_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <streambuf>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if __has_include(<span>)
+#include <span>
+#endif
+
+#if __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+#include <concepts>
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <ranges>
+#endif
+
+#include "lzpi.h"
+
+namespace lzpi
+{
+
+/*
+ * what a coder needs to continue, or done once its stream is written
+ */
+enum class status {
+	done = 0,
+	input = LZPI_DEC_INPUT,
+	output = LZPI_DEC_OUTPUT,
+};
+
+/*
+ * throw the errno value err
+ */
+[[noreturn]] inline void fail(int err)
+{
+	throw std::system_error(err, std::generic_category());
+}
+
+/*
+ * the resumable compressor of lzpi_enc, writing the same stream as lzpi
+ * however its input and output are split
+ */
+class encoder {
+    public:
+	encoder() : e_(lzpi_enc_new())
+	{
+		if (!e_)
+			fail(errno);
+	}
+
+	/*
+	 * compress in[0:ni] to out[0:no] like lzpi_enc, storing the bytes
+	 * consumed and produced in ni and no, until end marks the last input
+	 */
+	status operator()(const void *in, std::size_t &ni, void *out,
+			  std::size_t &no, bool end = false)
+	{
+		return static_cast<status>(
+			lzpi_enc(e_.get(), static_cast<const std::uint8_t *>(in),
+				 &ni, static_cast<std::uint8_t *>(out), &no, end));
+	}
+
+    private:
+	struct free_enc {
+		void operator()(struct lzpi_enc *e) const
+		{
+			lzpi_enc_free(e);
+		}
+	};
+
+	std::unique_ptr<struct lzpi_enc, free_enc> e_;
+};
+
+/*
+ * the resumable decompressor of lzpi_dec
+ */
+class decoder {
+    public:
+	decoder()
+	{
+		lzpi_dec_init(&d_);
+	}
+
+	/*
+	 * decompress in[0:ni] to out[0:no] like lzpi_dec, storing the bytes
+	 * consumed and produced in ni and no
+	 */
+	status operator()(const void *in, std::size_t &ni, void *out,
+			  std::size_t &no)
+	{
+		return static_cast<status>(
+			lzpi_dec(&d_, static_cast<const std::uint8_t *>(in), &ni,
+				 static_cast<std::uint8_t *>(out), &no));
+	}
+
+	/*
+	 * whether the input so far forms a whole stream
+	 */
+	bool done() const
+	{
+		return lzpi_dec_done(&d_);
+	}
+
+    private:
+	struct lzpi_dec d_;
+};
+
+/*
+ * the size of the blocks the streambufs code at a time
+ */
+constexpr std::size_t block_size = std::size_t{ 1 } << 16;
+
+/*
+ * a streambuf compressing what is written to it into the streambuf sink,
+ * a block at a time, which writes the end of the stream on finish or when
+ * destroyed
+ * writes of at least a block go straight to the compressor
+ */
+class ocompressbuf : public std::streambuf {
+    public:
+	explicit ocompressbuf(std::streambuf *sink)
+		: sink_(sink), in_(block_size), out_(block_size)
+	{
+		setp(in_.data(), in_.data() + in_.size());
+	}
+
+	ocompressbuf(const ocompressbuf &) = delete;
+	ocompressbuf &operator=(const ocompressbuf &) = delete;
+
+	~ocompressbuf() override
+	{
+		finish();
+	}
+
+	/*
+	 * write the end of the stream, and return false if the sink failed
+	 * or the stream has already ended
+	 */
+	bool finish()
+	{
+		if (ended_)
+			return false;
+		ended_ = true;
+		return put(pbase(), pptr(), true);
+	}
+
+    protected:
+	int_type overflow(int_type c) override
+	{
+		if (ended_ || !put(pbase(), pptr(), false))
+			return traits_type::eof();
+		setp(in_.data(), in_.data() + in_.size());
+		if (!traits_type::eq_int_type(c, traits_type::eof())) {
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	std::streamsize xsputn(const char *s, std::streamsize n) override
+	{
+		if (static_cast<std::size_t>(n) < in_.size())
+			return std::streambuf::xsputn(s, n);
+		if (ended_ || !put(pbase(), pptr(), false))
+			return 0;
+		setp(in_.data(), in_.data() + in_.size());
+		return put(s, s + n, false) ? n : 0;
+	}
+
+	/*
+	 * hand the output so far to the sink, short of the tokens of the
+	 * window, which only the end of the stream writes
+	 */
+	int sync() override
+	{
+		if (ended_ || !put(pbase(), pptr(), false))
+			return -1;
+		setp(in_.data(), in_.data() + in_.size());
+		return sink_->pubsync();
+	}
+
+    private:
+	/*
+	 * compress p up to e to the sink, ending the stream if end is set
+	 */
+	bool put(const char *p, const char *e, bool end)
+	{
+		for (;;) {
+			std::size_t ni = static_cast<std::size_t>(e - p);
+			std::size_t no = out_.size();
+			const status s = enc_(p, ni, out_.data(), no, end);
+
+			p += ni;
+			if (sink_->sputn(out_.data(),
+					 static_cast<std::streamsize>(no)) !=
+			    static_cast<std::streamsize>(no))
+				return false;
+			if (s != status::output)
+				return true;
+		}
+	}
+
+	std::streambuf *sink_;
+	encoder enc_;
+	std::vector<char> in_;
+	std::vector<char> out_;
+	bool ended_ = false;
+};
+
+/*
+ * a streambuf reading what it decompresses from the streambuf source, a
+ * block at a time, which throws std::system_error with EIO if the source
+ * ends within a token
+ * reads of at least a block are decoded straight to the caller
+ */
+class idecompressbuf : public std::streambuf {
+    public:
+	explicit idecompressbuf(std::streambuf *source)
+		: source_(source), in_(block_size), out_(block_size)
+	{
+		setg(out_.data(), out_.data(), out_.data());
+	}
+
+	idecompressbuf(const idecompressbuf &) = delete;
+	idecompressbuf &operator=(const idecompressbuf &) = delete;
+
+    protected:
+	int_type underflow() override
+	{
+		const std::size_t n = get(out_.data(), out_.size());
+
+		setg(out_.data(), out_.data(), out_.data() + n);
+		return n ? traits_type::to_int_type(*gptr()) :
+			   traits_type::eof();
+	}
+
+	std::streamsize xsgetn(char *s, std::streamsize n) override
+	{
+		const std::streamsize k = egptr() - gptr();
+
+		if (n - k < static_cast<std::streamsize>(out_.size()))
+			return std::streambuf::xsgetn(s, n);
+		std::memcpy(s, gptr(), static_cast<std::size_t>(k));
+		setg(out_.data(), out_.data(), out_.data());
+		return k + static_cast<std::streamsize>(get(
+				   s + k, static_cast<std::size_t>(n - k)));
+	}
+
+    private:
+	/*
+	 * decode up to n bytes to s, fewer only at the end of the stream, and
+	 * return how many
+	 */
+	std::size_t get(char *s, std::size_t n)
+	{
+		std::size_t k = 0;
+
+		while (k != n) {
+			std::size_t ni = static_cast<std::size_t>(e_ - p_);
+			std::size_t no = n - k;
+
+			dec_(in_.data() + p_, ni, s + k, no);
+			p_ += ni;
+			k += no;
+			if (k == n || p_ != e_)
+				continue;
+			p_ = 0;
+			e_ = static_cast<std::size_t>(source_->sgetn(
+				in_.data(),
+				static_cast<std::streamsize>(in_.size())));
+			if (!e_) {
+				if (!dec_.done())
+					fail(EIO);
+				break;
+			}
+		}
+		return k;
+	}
+
+	std::streambuf *source_;
+	decoder dec_;
+	std::vector<char> in_;
+	std::vector<char> out_;
+	std::size_t p_ = 0;
+	std::size_t e_ = 0;
+};
+
+#ifdef __cpp_lib_span
+
+/*
+ * in compressed exactly like lzpi
+ */
+inline std::vector<std::byte> compress(std::span<const std::byte> in)
+{
+	/* every literal costs a byte and a control bit */
+	std::vector<std::byte> out(in.size() + (in.size() + 7) / 8);
+	lzpi_stream s{ reinterpret_cast<const std::uint8_t *>(in.data()),
+		       in.size(),
+		       reinterpret_cast<std::uint8_t *>(out.data()),
+		       out.size(),
+		       0,
+		       0 };
+
+	if (const int err = lzpi_compress_batch(&s, 1))
+		fail(err);
+	out.resize(s.len);
+	return out;
+}
+
+/*
+ * in decompressed, which fails with EIO if it ends within a token
+ */
+inline std::vector<std::byte> decompress(std::span<const std::byte> in)
+{
+	std::vector<std::byte> out(in.size() * 2 + block_size);
+	decoder d;
+	std::size_t i = 0, o = 0;
+
+	for (;;) {
+		std::size_t ni = in.size() - i, no = out.size() - o;
+		const status s = d(in.data() + i, ni, out.data() + o, no);
+
+		i += ni;
+		o += no;
+		if (s == status::input)
+			break;
+		out.resize(out.size() * 2);
+	}
+	if (!d.done())
+		fail(EIO);
+	out.resize(o);
+	return out;
+}
+
+/*
+ * decompress in to out, returning the length of the output, which fails
+ * with ENOBUFS if it does not fit and with EIO if in ends within a token
+ */
+inline std::size_t decompress(std::span<const std::byte> in,
+			      std::span<std::byte> out)
+{
+	lzpi_stream s{ reinterpret_cast<const std::uint8_t *>(in.data()),
+		       in.size(),
+		       reinterpret_cast<std::uint8_t *>(out.data()),
+		       out.size(),
+		       0,
+		       0 };
+
+	if (const int err = lzpi_decompress_batch(&s, 1))
+		fail(err);
+	return s.len;
+}
+
+#if __cpp_nontype_template_args >= 201911L
+
+namespace detail
+{
+
+/*
+ * the longest output of the compressor for n bytes of input, of which every
+ * literal costs a byte and a control bit
+ */
+constexpr std::size_t bound(std::size_t n)
+{
+	return n + (n + 7) / 8;
+}
+
+/*
+ * the output of pack, out[0:n]
+ */
+template <std::size_t N> struct packed {
+	std::array<std::uint8_t, N> out{};
+	std::size_t n = 0;
+};
+
+/*
+ * src compressed exactly like the compressor of lzpi, which tries the
+ * distances of the last two matches before the first of the longest matches
+ * of the lookahead in the dictionary, here walking only the positions that
+ * hold its first byte, newest to oldest
+ */
+template <class T>
+constexpr packed<bound(std::tuple_size_v<T>)> pack(const T &src)
+{
+	constexpr std::size_t ring = 256;
+	const std::size_t len = src.size();
+	packed<bound(std::tuple_size_v<T>)> r;
+	std::size_t head[256] = {}, prev[ring] = {};
+	std::uint8_t rep[2] = { 0, 0 };
+	std::size_t p = 0, g = 0;
+	unsigned k = 8;
+
+	const auto at = [&](std::size_t i) {
+		return static_cast<std::uint8_t>(src[i]);
+	};
+
+	while (p != len) {
+		const std::size_t d = p < ring ? p : ring;
+		const std::size_t n = len - p < ring ? len - p : ring;
+		std::size_t o = 0, l = 0;
+
+		if (k == 8) {
+			g = r.n++;
+			k = 0;
+		}
+
+		/* the whole lookahead at the distance of a last match */
+		for (unsigned j = 0; j != 2 && !l; ++j) {
+			const std::size_t x = rep[j] + 1u;
+			std::size_t m = 0;
+
+			while (x <= d && m != n && at(p + m) == at(p + m - x))
+				++m;
+			if (x <= d && m == n) {
+				o = d - x;
+				l = n;
+			}
+		}
+		for (std::size_t q = l ? 0 : head[at(p)]; q && q > p - d;
+		     q = prev[(q - 1) % ring]) {
+			std::size_t m = 1;
+
+			while (m != n && at(q - 1 + m) == at(p + m))
+				++m;
+			if (m >= l) {
+				o = q - 1 - (p - d);
+				l = m;
+			}
+		}
+
+		/* not worth encoding */
+		if (l < 2 || (l == 2 && n > 3 && at(p + 2) == at(p) &&
+			      (at(p + 3) == at(p) || at(p + 3) == at(p - d + l)))) {
+			l = 1;
+			r.out[r.n++] = at(p);
+		} else {
+			const std::uint8_t m = static_cast<std::uint8_t>(d - o - 1);
+
+			r.out[g] |= static_cast<std::uint8_t>(1u << k);
+			r.out[r.n++] = m;
+			r.out[r.n++] = static_cast<std::uint8_t>(l - 1);
+			if (m != rep[0]) {
+				rep[1] = rep[0];
+				rep[0] = m;
+			}
+		}
+		++k;
+
+		/* the positions of the token join the chains of their bytes */
+		for (const std::size_t e = p + l; p != e; ++p) {
+			prev[p % ring] = head[at(p)];
+			head[at(p)] = p + 1;
+		}
+	}
+	return r;
+}
+
+} // namespace detail
+
+/*
+ * the std::array D of bytes compressed at compile time exactly like lzpi,
+ * as a std::array of its length, which suits assets of some KiB
+ */
+template <auto D> constexpr auto compress()
+{
+	constexpr auto r = detail::pack(D);
+	std::array<std::uint8_t, r.n> out{};
+
+	for (std::size_t k = 0; k != r.n; ++k)
+		out[k] = r.out[k];
+	return out;
+}
+
+/*
+ * the std::array D of bytes, which the binary holds only as compressed by
+ * compress<D>, decompressed on the first call
+ */
+template <auto D> const std::array<std::uint8_t, D.size()> &unpack()
+{
+	static constexpr auto blob = compress<D>();
+	static const auto out = [] {
+		std::array<std::uint8_t, D.size()> o;
+
+		decompress(std::as_bytes(std::span(blob)),
+			   std::as_writable_bytes(std::span(o)));
+		return o;
+	}();
+
+	return out;
+}
+
+#endif
+
+#if __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+
+/*
+ * a lazy input range of the values a coroutine yields, each valid until
+ * the next is requested, which rethrows what the coroutine throws
+ */
+template <class T> class generator {
+    public:
+	struct promise_type {
+		const T *v = nullptr;
+		std::exception_ptr e;
+
+		generator get_return_object()
+		{
+			return generator(handle::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_always final_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_always yield_value(const T &x) noexcept
+		{
+			v = std::addressof(x);
+			return {};
+		}
+
+		void return_void() noexcept
+		{
+		}
+
+		void unhandled_exception() noexcept
+		{
+			e = std::current_exception();
+		}
+	};
+
+	using handle = std::coroutine_handle<promise_type>;
+
+	class iterator {
+	    public:
+		using iterator_concept = std::input_iterator_tag;
+		using difference_type = std::ptrdiff_t;
+		using value_type = std::remove_cvref_t<T>;
+
+		explicit iterator(handle h = nullptr) : h_(h)
+		{
+		}
+
+		const T &operator*() const
+		{
+			return *h_.promise().v;
+		}
+
+		iterator &operator++()
+		{
+			next(h_);
+			return *this;
+		}
+
+		void operator++(int)
+		{
+			++*this;
+		}
+
+		bool operator==(std::default_sentinel_t) const
+		{
+			return !h_ || h_.done();
+		}
+
+	    private:
+		handle h_;
+	};
+
+	generator(generator &&g) noexcept : h_(std::exchange(g.h_, nullptr))
+	{
+	}
+
+	generator &operator=(generator &&g) noexcept
+	{
+		if (this != &g) {
+			if (h_)
+				h_.destroy();
+			h_ = std::exchange(g.h_, nullptr);
+		}
+		return *this;
+	}
+
+	~generator()
+	{
+		if (h_)
+			h_.destroy();
+	}
+
+	/*
+	 * run the coroutine to its first value, once
+	 */
+	iterator begin()
+	{
+		next(h_);
+		return iterator(h_);
+	}
+
+	std::default_sentinel_t end() const noexcept
+	{
+		return {};
+	}
+
+    private:
+	explicit generator(handle h) : h_(h)
+	{
+	}
+
+	/*
+	 * run the coroutine h to its next value, rethrowing what it threw
+	 */
+	static void next(handle h)
+	{
+		h.resume();
+		if (h.promise().e)
+			std::rethrow_exception(std::exchange(h.promise().e, {}));
+	}
+
+	handle h_;
+};
+
+/*
+ * a range of chunks of bytes, such as another generator of them
+ */
+template <class R>
+concept chunks = std::ranges::input_range<R> &&
+		 std::convertible_to<std::ranges::range_reference_t<R>,
+				     std::span<const std::byte>>;
+
+/*
+ * the stream read from the chunks of source decompressed a block at a
+ * time, each yielded once full or at the end of the stream, which throws
+ * std::system_error with EIO if the source ends within a token
+ */
+template <chunks R>
+generator<std::span<const std::byte>>
+decode_chunks(R source, std::size_t block = block_size)
+{
+	std::vector<std::byte> out(block);
+	decoder d;
+	std::size_t o = 0;
+
+	for (std::span<const std::byte> in : source) {
+		status s;
+
+		do {
+			/* any valid pointer stands for an empty chunk */
+			const void *p = in.empty() ? out.data() : in.data();
+			std::size_t ni = in.size(), no = block - o;
+
+			s = d(p, ni, out.data() + o, no);
+			in = in.subspan(ni);
+			if ((o += no) == block) {
+				co_yield std::span<const std::byte>(out.data(), o);
+				o = 0;
+			}
+		} while (s != status::input);
+	}
+	if (o)
+		co_yield std::span<const std::byte>(out.data(), o);
+	if (!d.done())
+		fail(EIO);
+}
+
+/*
+ * the stream in decompressed like decode_chunks
+ */
+inline generator<std::span<const std::byte>>
+decode_chunks(std::span<const std::byte> in, std::size_t block = block_size)
+{
+	return decode_chunks(std::array<std::span<const std::byte>, 1>{ in },
+			     block);
+}
+
+/*
+ * the chunks of source compressed exactly like lzpi to a block at a time,
+ * suspending to yield each once full or at the end of the stream
+ */
+template <chunks R>
+generator<std::span<const std::byte>>
+encode_chunks(R source, std::size_t block = block_size)
+{
+	std::vector<std::byte> out(block);
+	encoder e;
+	std::size_t o = 0;
+
+	/* the chunk is consumed before the next, which may reuse it */
+	for (auto it = std::ranges::begin(source);; ++it) {
+		const bool end = it == std::ranges::end(source);
+		std::span<const std::byte> in;
+		status s;
+
+		if (!end)
+			in = *it;
+		do {
+			/* any valid pointer stands for an empty chunk */
+			const void *p = in.empty() ? out.data() : in.data();
+			std::size_t ni = in.size(), no = block - o;
+
+			s = e(p, ni, out.data() + o, no, end);
+			in = in.subspan(ni);
+			if ((o += no) == block) {
+				co_yield std::span<const std::byte>(out.data(), o);
+				o = 0;
+			}
+		} while (s == status::output);
+		if (end)
+			break;
+	}
+	if (o)
+		co_yield std::span<const std::byte>(out.data(), o);
+}
+
+#endif
+
+#endif
+
+} // namespace lzpi
+
+#endif
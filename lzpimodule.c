@@ -0,0 +1,535 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * the python module lzpi, which takes any object with the buffer protocol
+ * and codes with the gil released
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#define LZPI_NO_MAIN
+#include "lzpi.c"
+
+/*
+ * the longest output of the compressor for n bytes of input, of which every
+ * literal costs a byte and a control bit
+ */
+#define PY_BOUND(n) ((n) + ((n) + 7) / 8)
+
+/*
+ * the initial and the largest step of growth of a decompressed object
+ */
+#define PY_CHUNK ((Py_ssize_t)1 << 16)
+#define PY_CHUNK_MAX ((Py_ssize_t)1 << 26)
+
+/*
+ * raise OSError for the errno value err and return NULL
+ */
+static PyObject *py_error(int err)
+{
+	errno = err;
+	return PyErr_SetFromErrno(PyExc_OSError);
+}
+
+/*
+ * grow the bytes object *b of which n bytes are used to receive more
+ * output, and return 0 or -1 with an exception set
+ */
+static int py_grow(PyObject **b, Py_ssize_t n)
+{
+	Py_ssize_t k = n < PY_CHUNK ? PY_CHUNK : n;
+
+	k = k > PY_CHUNK_MAX ? PY_CHUNK_MAX : k;
+	if (UNLIKELY(n > PY_SSIZE_T_MAX - k)) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	return _PyBytes_Resize(b, n + k);
+}
+
+/*
+ * decode in[0:n] with d, appending to the bytes object *b of which *o
+ * bytes are used, growing it as needed, and return 0 or -1 with an
+ * exception set
+ */
+static int py_decode(struct lzpi_dec *d, const uint8_t *in, size_t n,
+		     PyObject **b, Py_ssize_t *o)
+{
+	for (;;) {
+		size_t ni = n, no = (size_t)(PyBytes_GET_SIZE(*b) - *o);
+		uint8_t *out = (uint8_t *)PyBytes_AS_STRING(*b) + *o;
+		int ret;
+
+		Py_BEGIN_ALLOW_THREADS
+		ret = lzpi_dec(d, in, &ni, out, &no);
+		Py_END_ALLOW_THREADS
+
+		in += ni;
+		n -= ni;
+		*o += (Py_ssize_t)no;
+		if (ret == LZPI_DEC_INPUT)
+			return 0;
+		if (UNLIKELY(py_grow(b, *o)))
+			return -1;
+	}
+}
+
+PyDoc_STRVAR(py_compress_doc,
+	     "compress(data) -> bytes\n\n"
+	     "Compress data exactly like the lzpi command.");
+
+static PyObject *py_compress(PyObject *self, PyObject *args)
+{
+	struct lzpi_stream s;
+	PyObject *b = NULL;
+	Py_buffer in;
+	int ret;
+
+	(void)self;
+	if (!PyArg_ParseTuple(args, "y*:compress", &in))
+		return NULL;
+	if (UNLIKELY(in.len > (PY_SSIZE_T_MAX - 7) / 9 * 8)) {
+		PyErr_NoMemory();
+		goto out;
+	}
+	if (UNLIKELY(!(b = PyBytes_FromStringAndSize(NULL, PY_BOUND(in.len)))))
+		goto out;
+
+	s = (struct lzpi_stream){ .in = in.buf,
+				  .n = (size_t)in.len,
+				  .out = (uint8_t *)PyBytes_AS_STRING(b),
+				  .cap = (size_t)PyBytes_GET_SIZE(b) };
+	Py_BEGIN_ALLOW_THREADS
+	ret = lzpi_compress_batch(&s, 1);
+	Py_END_ALLOW_THREADS
+
+	if (UNLIKELY(ret)) {
+		Py_CLEAR(b);
+		py_error(ret);
+	} else if (UNLIKELY(_PyBytes_Resize(&b, (Py_ssize_t)s.len))) {
+		b = NULL;
+	}
+out:
+	PyBuffer_Release(&in);
+	return b;
+}
+
+PyDoc_STRVAR(py_compress_into_doc,
+	     "compress_into(data, out) -> int\n\n"
+	     "Compress data into the writable buffer out, such as a bytearray\n"
+	     "or memoryview, and return the length of the output. Raises\n"
+	     "OSError with ENOBUFS if it does not fit.");
+
+static PyObject *py_compress_into(PyObject *self, PyObject *args)
+{
+	struct lzpi_stream s;
+	Py_buffer in, out;
+	int ret;
+
+	(void)self;
+	if (!PyArg_ParseTuple(args, "y*w*:compress_into", &in, &out))
+		return NULL;
+
+	s = (struct lzpi_stream){ .in = in.buf,
+				  .n = (size_t)in.len,
+				  .out = out.buf,
+				  .cap = (size_t)out.len };
+	Py_BEGIN_ALLOW_THREADS
+	ret = lzpi_compress_batch(&s, 1);
+	Py_END_ALLOW_THREADS
+
+	PyBuffer_Release(&out);
+	PyBuffer_Release(&in);
+	if (UNLIKELY(ret))
+		return py_error(ret);
+	return PyLong_FromSize_t(s.len);
+}
+
+PyDoc_STRVAR(py_decompress_doc,
+	     "decompress(data) -> bytes\n\n"
+	     "Decompress the stream data. Raises OSError with EIO if it is\n"
+	     "truncated.");
+
+static PyObject *py_decompress(PyObject *self, PyObject *args)
+{
+	struct lzpi_dec d;
+	PyObject *b = NULL;
+	Py_ssize_t o = 0;
+	Py_buffer in;
+
+	(void)self;
+	if (!PyArg_ParseTuple(args, "y*:decompress", &in))
+		return NULL;
+
+	lzpi_dec_init(&d);
+	if (UNLIKELY(!(b = PyBytes_FromStringAndSize(NULL, PY_CHUNK))) ||
+	    UNLIKELY(py_decode(&d, in.buf, (size_t)in.len, &b, &o)))
+		goto fail;
+	if (UNLIKELY(!lzpi_dec_done(&d))) {
+		py_error(EIO);
+		goto fail;
+	}
+	if (UNLIKELY(_PyBytes_Resize(&b, o)))
+		b = NULL;
+	PyBuffer_Release(&in);
+	return b;
+fail:
+	Py_XDECREF(b);
+	PyBuffer_Release(&in);
+	return NULL;
+}
+
+PyDoc_STRVAR(py_decompress_into_doc,
+	     "decompress_into(data, out) -> int\n\n"
+	     "Decompress the stream data into the writable buffer out and\n"
+	     "return the length of the output. Raises OSError with ENOBUFS if\n"
+	     "it does not fit or with EIO if data is truncated.");
+
+static PyObject *py_decompress_into(PyObject *self, PyObject *args)
+{
+	struct lzpi_stream s;
+	Py_buffer in, out;
+	int ret;
+
+	(void)self;
+	if (!PyArg_ParseTuple(args, "y*w*:decompress_into", &in, &out))
+		return NULL;
+
+	s = (struct lzpi_stream){ .in = in.buf,
+				  .n = (size_t)in.len,
+				  .out = out.buf,
+				  .cap = (size_t)out.len };
+	Py_BEGIN_ALLOW_THREADS
+	ret = lzpi_decompress_batch(&s, 1);
+	Py_END_ALLOW_THREADS
+
+	PyBuffer_Release(&out);
+	PyBuffer_Release(&in);
+	if (UNLIKELY(ret))
+		return py_error(ret);
+	return PyLong_FromSize_t(s.len);
+}
+
+/*
+ * a streaming compressor, whose lock serializes the calls that release the
+ * gil, ended once flushed
+ */
+typedef struct {
+	PyObject_HEAD
+	struct lzpi_enc *e;
+	PyThread_type_lock lock;
+	int ended;
+} py_compressor;
+
+static PyObject *py_compressor_new(PyTypeObject *type, PyObject *args,
+				   PyObject *kw)
+{
+	static char *kwlist[] = { NULL };
+	py_compressor *c;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, ":Compressor", kwlist))
+		return NULL;
+	if (UNLIKELY(!(c = (py_compressor *)type->tp_alloc(type, 0))))
+		return NULL;
+	c->ended = 0;
+	c->lock = PyThread_allocate_lock();
+	if (UNLIKELY(!(c->e = lzpi_enc_new())) || UNLIKELY(!c->lock)) {
+		Py_DECREF(c);
+		return PyErr_NoMemory();
+	}
+	return (PyObject *)c;
+}
+
+static void py_compressor_dealloc(py_compressor *c)
+{
+	lzpi_enc_free(c->e);
+	if (c->lock)
+		PyThread_free_lock(c->lock);
+	Py_TYPE(c)->tp_free((PyObject *)c);
+}
+
+/*
+ * compress in[0:n] with c, ending the stream if end is set, to the bytes
+ * object *b, and return 0 or -1 with an exception set
+ */
+static int py_encode(py_compressor *c, const uint8_t *in, size_t n, int end,
+		     PyObject **b)
+{
+	Py_ssize_t o = 0;
+
+	if (UNLIKELY(c->ended)) {
+		PyErr_SetString(PyExc_ValueError, "compressor flushed");
+		return -1;
+	}
+	if (UNLIKELY(!(*b = PyBytes_FromStringAndSize(NULL, PY_CHUNK))))
+		return -1;
+	for (;;) {
+		size_t ni = n, no = (size_t)(PyBytes_GET_SIZE(*b) - o);
+		uint8_t *out = (uint8_t *)PyBytes_AS_STRING(*b) + o;
+		int ret;
+
+		Py_BEGIN_ALLOW_THREADS
+		/* any valid pointer stands for no input */
+		ret = lzpi_enc(c->e, n ? in : out, &ni, out, &no, end);
+		Py_END_ALLOW_THREADS
+
+		in += ni;
+		n -= ni;
+		o += (Py_ssize_t)no;
+		if (ret != LZPI_DEC_OUTPUT)
+			break;
+		if (UNLIKELY(py_grow(b, o)))
+			return -1;
+	}
+	c->ended = end;
+	return _PyBytes_Resize(b, o);
+}
+
+/*
+ * compress in[0:n] with c like py_encode, one call at a time, to a new
+ * bytes object
+ */
+static PyObject *py_compressor_code(py_compressor *c, const uint8_t *in,
+				    size_t n, int end)
+{
+	PyObject *b = NULL;
+	int ret;
+
+	Py_BEGIN_ALLOW_THREADS
+	PyThread_acquire_lock(c->lock, WAIT_LOCK);
+	Py_END_ALLOW_THREADS
+	ret = py_encode(c, in, n, end, &b);
+	PyThread_release_lock(c->lock);
+
+	if (UNLIKELY(ret)) {
+		/* _PyBytes_Resize frees b itself when it fails */
+		Py_XDECREF(b);
+		return NULL;
+	}
+	return b;
+}
+
+PyDoc_STRVAR(py_compressor_compress_doc,
+	     "compress(data) -> bytes\n\n"
+	     "Compress data, returning the output ready so far. The window\n"
+	     "holds back the last input until more arrives or flush.");
+
+static PyObject *py_compressor_compress(py_compressor *c, PyObject *args)
+{
+	PyObject *b;
+	Py_buffer in;
+
+	if (!PyArg_ParseTuple(args, "y*:compress", &in))
+		return NULL;
+	b = py_compressor_code(c, in.buf, (size_t)in.len, 0);
+	PyBuffer_Release(&in);
+	return b;
+}
+
+PyDoc_STRVAR(py_compressor_flush_doc,
+	     "flush() -> bytes\n\n"
+	     "End the stream, returning the rest of the output.");
+
+static PyObject *py_compressor_flush(py_compressor *c, PyObject *args)
+{
+	(void)args;
+	return py_compressor_code(c, NULL, 0, 1);
+}
+
+static PyMethodDef py_compressor_methods[] = {
+	{ "compress", (PyCFunction)py_compressor_compress, METH_VARARGS,
+	  py_compressor_compress_doc },
+	{ "flush", (PyCFunction)py_compressor_flush, METH_NOARGS,
+	  py_compressor_flush_doc },
+	{ NULL, NULL, 0, NULL },
+};
+
+PyDoc_STRVAR(py_compressor_doc,
+	     "Compressor()\n\n"
+	     "A streaming compressor writing the same stream as compress.");
+
+static PyTypeObject py_compressor_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "lzpi.Compressor",
+	.tp_basicsize = sizeof(py_compressor),
+	.tp_dealloc = (destructor)py_compressor_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = py_compressor_doc,
+	.tp_methods = py_compressor_methods,
+	.tp_new = py_compressor_new,
+};
+
+/*
+ * a streaming decompressor, whose lock serializes the calls that release
+ * the gil
+ */
+typedef struct {
+	PyObject_HEAD
+	struct lzpi_dec d;
+	PyThread_type_lock lock;
+} py_decompressor;
+
+static PyObject *py_decompressor_new(PyTypeObject *type, PyObject *args,
+				     PyObject *kw)
+{
+	static char *kwlist[] = { NULL };
+	py_decompressor *d;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kw, ":Decompressor", kwlist))
+		return NULL;
+	if (UNLIKELY(!(d = (py_decompressor *)type->tp_alloc(type, 0))))
+		return NULL;
+	lzpi_dec_init(&d->d);
+	if (UNLIKELY(!(d->lock = PyThread_allocate_lock()))) {
+		Py_DECREF(d);
+		return PyErr_NoMemory();
+	}
+	return (PyObject *)d;
+}
+
+static void py_decompressor_dealloc(py_decompressor *d)
+{
+	if (d->lock)
+		PyThread_free_lock(d->lock);
+	Py_TYPE(d)->tp_free((PyObject *)d);
+}
+
+PyDoc_STRVAR(py_decompressor_decompress_doc,
+	     "decompress(data) -> bytes\n\n"
+	     "Decompress the next part of the stream, returning all the output\n"
+	     "it completes.");
+
+static PyObject *py_decompressor_decompress(py_decompressor *d,
+					    PyObject *args)
+{
+	PyObject *b = NULL;
+	Py_ssize_t o = 0;
+	Py_buffer in;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "y*:decompress", &in))
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	PyThread_acquire_lock(d->lock, WAIT_LOCK);
+	Py_END_ALLOW_THREADS
+	ret = UNLIKELY(!(b = PyBytes_FromStringAndSize(NULL, PY_CHUNK))) ||
+	      UNLIKELY(py_decode(&d->d, in.buf, (size_t)in.len, &b, &o)) ||
+	      UNLIKELY(_PyBytes_Resize(&b, o));
+	PyThread_release_lock(d->lock);
+
+	PyBuffer_Release(&in);
+	/* _PyBytes_Resize frees b itself when it fails */
+	return ret ? NULL : b;
+}
+
+PyDoc_STRVAR(py_decompressor_done_doc,
+	     "True if the input so far forms a whole stream, rather than one\n"
+	     "truncated within a token.");
+
+static PyObject *py_decompressor_done(py_decompressor *d, void *closure)
+{
+	(void)closure;
+	return PyBool_FromLong(lzpi_dec_done(&d->d));
+}
+
+static PyMethodDef py_decompressor_methods[] = {
+	{ "decompress", (PyCFunction)py_decompressor_decompress, METH_VARARGS,
+	  py_decompressor_decompress_doc },
+	{ NULL, NULL, 0, NULL },
+};
+
+static PyGetSetDef py_decompressor_getset[] = {
+	{ "done", (getter)py_decompressor_done, NULL,
+	  py_decompressor_done_doc, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
+PyDoc_STRVAR(py_decompressor_doc,
+	     "Decompressor()\n\n"
+	     "A streaming decompressor, fed the stream in parts of any size.");
+
+static PyTypeObject py_decompressor_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "lzpi.Decompressor",
+	.tp_basicsize = sizeof(py_decompressor),
+	.tp_dealloc = (destructor)py_decompressor_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = py_decompressor_doc,
+	.tp_methods = py_decompressor_methods,
+	.tp_getset = py_decompressor_getset,
+	.tp_new = py_decompressor_new,
+};
+
+static PyMethodDef py_methods[] = {
+	{ "compress", py_compress, METH_VARARGS, py_compress_doc },
+	{ "compress_into", py_compress_into, METH_VARARGS,
+	  py_compress_into_doc },
+	{ "decompress", py_decompress, METH_VARARGS, py_decompress_doc },
+	{ "decompress_into", py_decompress_into, METH_VARARGS,
+	  py_decompress_into_doc },
+	{ NULL, NULL, 0, NULL },
+};
+
+PyDoc_STRVAR(py_doc, "Compressor and decompressor for the LZSS variant used\n"
+		     "in the Raspberry Pi 4 boot EEPROM.");
+
+static struct PyModuleDef py_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "lzpi",
+	.m_doc = py_doc,
+	.m_size = -1,
+	.m_methods = py_methods,
+};
+
+/*
+ * add the type t to the module m as name, giving it the reference that
+ * PyModule_AddObject steals only when it succeeds
+ */
+static int py_add_type(PyObject *m, const char *name, PyTypeObject *t)
+{
+	Py_INCREF(t);
+	if (UNLIKELY(PyModule_AddObject(m, name, (PyObject *)t))) {
+		Py_DECREF(t);
+		return -1;
+	}
+	return 0;
+}
+
+PyMODINIT_FUNC PyInit_lzpi(void)
+{
+	PyObject *m;
+
+	if (PyType_Ready(&py_compressor_type) ||
+	    PyType_Ready(&py_decompressor_type))
+		return NULL;
+	if (UNLIKELY(!(m = PyModule_Create(&py_module))))
+		return NULL;
+	if (py_add_type(m, "Compressor", &py_compressor_type) ||
+	    py_add_type(m, "Decompressor", &py_decompressor_type)) {
+		Py_DECREF(m);
+		return NULL;
+	}
+	return m;
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * codecs of lzss formats related to that of lzpi, for inclusion after
+ * lzpi.c, whose match finders, copy kernels and file helpers they use
+ */
+
+#ifndef LZSS_H
+#define LZSS_H
+
+/*
+ * the most earlier positions with the same first two bytes the encoders of
+ * DEFINE_LZSS try for a match
+ */
+#define LZSS_DEPTH 256
+
+/*
+ * whether a window of 1 << O bytes and matches of up to (1 << L) - 1 + B
+ * bytes fit the ring of lzpi, so the lanes kernel can search them
+ */
+#define LZSS_LANES(O, L, B) \
+	((O) <= 8 && ((size_t)1 << (L)) - 1 + (B) <= RING_SIZE)
+
+/*
+ * the longest match at position i of src[0:n] with the lanes kernel of
+ * lzpi, at most ln bytes long and reaching back at most dn bytes, storing
+ * its distance in *bd
+ */
+static inline size_t lzss_lanes(const uint8_t *src, size_t n, size_t i,
+				size_t dn, size_t ln, size_t *bd)
+{
+	uint8_t w[RING_SIZE * 3];
+	const uint8_t *t;
+	size_t d, l;
+	struct pair p;
+
+	window_at(src, n, i, w, &t, &d, &l);
+	if (d > dn) {
+		t += d - dn;
+		d = dn;
+	}
+	l = l < ln ? l : ln;
+	kern->lanes(&t, &d, &l, &p, 1);
+	*bd = d - p.o;
+	return p.l;
+}
+
+/*
+ * define an lzss codec, fully specialized for a format of groups of G
+ * tokens behind G / 8 bytes of flags, little endian and lowest bit first, a
+ * set flag marking a match if F is 1 or a literal if F is 0, and of
+ * matches of at least M bytes coded big endian in O + L bits, the distance
+ * less one above the length less B, reaching back over a window of 1 << W
+ * bytes, before the start of which history reads as zeros
+ * DEFINE_LZSS(lzss_pi, 8, 8, 8, 2, 1, 8, 1) is the format of lzpi
+ * the encoder searches with the lanes kernel of lzpi where LZSS_LANES
+ * holds, and along hash chains of the last LZSS_DEPTH positions otherwise
+ * name##_encode and name##_decode code src[0:n] to dst[0:cap], storing the
+ * length of the output in *len, and return 0, ENOBUFS if that does not fit,
+ * or EIO if the input of name##_decode is truncated, and name##_compress
+ * and name##_decompress code file i to file o
+ */
+#define DEFINE_LZSS(name, W, O, L, M, B, G, F)                               \
+	static_assert((O) <= (W) && (W) < 32, "invalid window of " #name);   \
+	static_assert(!(((O) + (L)) % CHAR_BIT) && (O) + (L) <= 32,          \
+		      "invalid match of " #name);                            \
+	static_assert((M) >= 2 && (B) >= 1 && (M) >= (B),                    \
+		      "invalid length of " #name);                           \
+	static_assert((G) == 8 || (G) == 16 || (G) == 32,                    \
+		      "invalid group of " #name);                            \
+                                                                             \
+	static int name##_encode(const uint8_t *src, size_t n, uint8_t *dst, \
+				 size_t cap, size_t *len)                    \
+	{                                                                    \
+		const size_t wn = (size_t)1 << (W), dn = (size_t)1 << (O);   \
+		const size_t ln = ((size_t)1 << (L)) - 1 + (B);              \
+		const int lanes = LZSS_LANES(O, L, B);                       \
+		uint32_t *head = NULL, *prev = NULL;                         \
+		uint8_t *op = dst, *fp = dst;                                \
+		unsigned k = (G);                                            \
+		int ret = 0;                                                 \
+                                                                             \
+		if (UNLIKELY(n > UINT32_MAX - 1)) {                          \
+			ret = EFBIG;                                         \
+			goto out;                                            \
+		}                                                            \
+		if (!lanes &&                                                \
+		    (UNLIKELY(!(head = calloc((size_t)1 << 16,               \
+					      sizeof *head))) ||             \
+		     UNLIKELY(!(prev = malloc(wn * sizeof *prev))))) {       \
+			ret = ENOMEM;                                        \
+			goto out;                                            \
+		}                                                            \
+		for (size_t i = 0, bl, bd, q; i < n; i += bl) {              \
+			bl = 1;                                              \
+			bd = 0;                                              \
+			if (k == (G)) {                                      \
+				if (UNLIKELY((size_t)(dst + cap - op) <      \
+					     (G) / CHAR_BIT)) {              \
+					ret = ENOBUFS;                       \
+					break;                               \
+				}                                            \
+				fp = op;                                     \
+				memset(fp, 0, (G) / CHAR_BIT);               \
+				op += (G) / CHAR_BIT;                        \
+				k = 0;                                       \
+			}                                                    \
+                                                                             \
+			if (lanes && n - i >= (M)) {                         \
+				if ((bl = lzss_lanes(src, n, i, dn, ln,      \
+						     &bd)) < (M))            \
+					bl = 1;                              \
+			} else if (n - i >= (M)) {                           \
+				/* the nearest of the longest matches */      \
+				const size_t e = n - i < ln ? n - i : ln;    \
+				unsigned d = LZSS_DEPTH;                     \
+                                                                             \
+				for (uint32_t j = head[src[i] |              \
+						       src[i + 1] << 8];     \
+				     j && i - (j - 1) <= dn && d--;          \
+				     j = prev[(j - 1) & (wn - 1)]) {         \
+					size_t x = 0;                        \
+                                                                             \
+					while (x != e &&                     \
+					       src[j - 1 + x] == src[i + x]) \
+						++x;                         \
+					if (x > bl) {                        \
+						bl = x;                      \
+						bd = i - (j - 1);            \
+						if (x == e)                  \
+							break;               \
+					}                                    \
+				}                                            \
+				if (bl < (M))                                \
+					bl = 1;                              \
+			}                                                    \
+                                                                             \
+			if (bl > 1) {                                        \
+				const uint32_t c =                           \
+					(uint32_t)(bd - 1) << (L) |          \
+					(uint32_t)(bl - (B));                \
+                                                                             \
+				if (UNLIKELY((size_t)(dst + cap - op) <      \
+					     ((O) + (L)) / CHAR_BIT)) {      \
+					ret = ENOBUFS;                       \
+					break;                               \
+				}                                            \
+				for (unsigned s = (O) + (L); s;)             \
+					*op++ = (uint8_t)(c >> (s -= CHAR_BIT)); \
+			} else {                                             \
+				if (UNLIKELY(op == dst + cap)) {             \
+					ret = ENOBUFS;                       \
+					break;                               \
+				}                                            \
+				*op++ = src[i];                              \
+			}                                                    \
+			if ((bl > 1) == (F))                                 \
+				fp[k / CHAR_BIT] |= (uint8_t)(1u << k % CHAR_BIT); \
+			++k;                                                 \
+                                                                             \
+			/* chain every position covered with two bytes */    \
+			for (q = i; !lanes && q != i + bl && q + 1 < n; ++q) { \
+				const unsigned h = src[q] | src[q + 1] << 8; \
+                                                                             \
+				prev[q & (wn - 1)] = head[h];                \
+				head[h] = (uint32_t)(q + 1);                 \
+			}                                                    \
+		}                                                            \
+	out:                                                                 \
+		free(prev);                                                  \
+		free(head);                                                  \
+		*len = (size_t)(op - dst);                                   \
+		return ret;                                                  \
+	}                                                                    \
+                                                                             \
+	static int name##_decode(const uint8_t *src, size_t n, uint8_t *dst, \
+				 size_t cap, size_t *len)                    \
+	{                                                                    \
+		const uint8_t *ip = src, *const ie = src + n;                \
+		uint8_t *op = dst, *const oe = dst + cap;                    \
+		int ret = 0;                                                 \
+                                                                             \
+		while (ip != ie) {                                           \
+			uint32_t fl = 0;                                     \
+                                                                             \
+			if (UNLIKELY((size_t)(ie - ip) < (G) / CHAR_BIT)) {  \
+				ret = EIO;                                   \
+				break;                                       \
+			}                                                    \
+			for (unsigned s = 0; s != (G); s += CHAR_BIT)        \
+				fl |= (uint32_t)*ip++ << s;                  \
+                                                                             \
+			for (unsigned k = 0; k != (G) && ip != ie;           \
+			     ++k, fl >>= 1) {                                \
+				uint32_t c = 0;                              \
+				size_t d, x, z;                              \
+                                                                             \
+				if ((fl & 1) != (F)) {                       \
+					if (UNLIKELY(op == oe)) {            \
+						ret = ENOBUFS;               \
+						goto out;                    \
+					}                                    \
+					*op++ = *ip++;                       \
+					continue;                            \
+				}                                            \
+				if (UNLIKELY((size_t)(ie - ip) <             \
+					     ((O) + (L)) / CHAR_BIT)) {      \
+					ret = EIO;                           \
+					goto out;                            \
+				}                                            \
+				for (unsigned s = 0; s != (O) + (L);         \
+				     s += CHAR_BIT)                          \
+					c = c << CHAR_BIT | *ip++;           \
+				d = (c >> (L)) + 1;                          \
+				x = (c & (((uint32_t)1 << (L)) - 1)) + (B);  \
+				if (UNLIKELY((size_t)(oe - op) < x)) {       \
+					ret = ENOBUFS;                       \
+					goto out;                            \
+				}                                            \
+                                                                             \
+				/* history before the start reads as zeros */ \
+				z = (size_t)(op - dst) < d ?                 \
+					    d - (size_t)(op - dst) :         \
+					    0;                               \
+				z = z < x ? z : x;                           \
+				memset(op, 0, z);                            \
+				op += z;                                     \
+				if (!(x -= z))                               \
+					continue;                            \
+				if ((size_t)(oe - op) >= x + KERNEL_SLACK)   \
+					kern->copy(op, d, x);                \
+				else                                         \
+					copy_scalar(op, d, x);               \
+				op += x;                                     \
+			}                                                    \
+		}                                                            \
+	out:                                                                 \
+		*len = (size_t)(op - dst);                                   \
+		return ret;                                                  \
+	}                                                                    \
+                                                                             \
+	static int name##_compress(FILE *i, FILE *o)                         \
+	{                                                                    \
+		uint8_t *src, *dst = NULL;                                   \
+		size_t n, cap, k;                                            \
+		int ret;                                                     \
+                                                                             \
+		if (UNLIKELY(ret = slurp(i, &src, &n)))                      \
+			return ret;                                          \
+		/* every literal costs a byte and a flag */                  \
+		cap = n + (n + (G) - 1) / (G) * ((G) / CHAR_BIT);            \
+		if (UNLIKELY(!(dst = malloc(cap + 1))))                      \
+			ret = ENOMEM;                                        \
+		else if (LIKELY(!(ret = name##_encode(src, n, dst, cap,      \
+						      &k))))                 \
+			ret = flush(dst, k, o);                              \
+		free(dst);                                                   \
+		free(src);                                                   \
+		if (UNLIKELY(ret))                                           \
+			errno = ret;                                         \
+		return ret;                                                  \
+	}                                                                    \
+                                                                             \
+	static int name##_decompress(FILE *i, FILE *o)                       \
+	{                                                                    \
+		uint8_t *src, *dst = NULL;                                   \
+		size_t n, cap, k;                                            \
+		int ret;                                                     \
+                                                                             \
+		if (UNLIKELY(ret = slurp(i, &src, &n)))                      \
+			return ret;                                          \
+		/* start over with twice the room until the output fits */   \
+		for (cap = n + RING_SIZE;; cap <<= 1) {                      \
+			uint8_t *t;                                          \
+                                                                             \
+			if (UNLIKELY(!(t = realloc(dst, cap)))) {            \
+				ret = ENOMEM;                                \
+				break;                                       \
+			}                                                    \
+			dst = t;                                             \
+			if ((ret = name##_decode(src, n, dst, cap, &k)) !=   \
+			    ENOBUFS)                                         \
+				break;                                       \
+		}                                                            \
+		if (!ret || ret == EIO) {                                    \
+			/* keep the output decoded so far, as lzpi -d */     \
+			const int err = flush(dst, k, o);                    \
+                                                                             \
+			if (!ret)                                            \
+				ret = err;                                   \
+		}                                                            \
+		free(dst);                                                   \
+		free(src);                                                   \
+		if (UNLIKELY(ret))                                           \
+			errno = ret;                                         \
+		return ret;                                                  \
+	}
+
+#endif
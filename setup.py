@@ -0,0 +1,16 @@
+from setuptools import Extension, setup
+
+setup(
+    name="lzpi",
+    description="Compressor and decompressor for the LZSS variant used in "
+    "the Raspberry Pi 4 boot EEPROM",
+    license="MIT",
+    ext_modules=[
+        Extension(
+            "lzpi",
+            sources=["lzpimodule.c"],
+            depends=["lzpi.c", "lzpi.h", "core.c"],
+            extra_compile_args=["-std=c11", "-pthread"],
+        )
+    ],
+)
@@ -0,0 +1,425 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+/*
+ * the tests of the library interface of lzpi.h, run by make test against
+ * lzpi.c built with -DLZPI_NO_MAIN
+ */
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "lzpi.h"
+
+/*
+ * a buffer bf of length n
+ */
+struct buf {
+	uint8_t *bf;
+	size_t n;
+};
+
+/*
+ * read all of file f into b
+ */
+static int load(const char *f, struct buf *b)
+{
+	FILE *i = fopen(f, "rb");
+	size_t cap = 1 << 16;
+	int ret = 0;
+
+	b->bf = NULL;
+	b->n = 0;
+	if (!i)
+		return errno;
+	for (;;) {
+		uint8_t *t = realloc(b->bf, cap <<= 1);
+
+		if (!t) {
+			ret = ENOMEM;
+			break;
+		}
+		b->bf = t;
+		b->n += fread(b->bf + b->n, 1, cap - b->n, i);
+		if (b->n != cap) {
+			if (ferror(i))
+				ret = EIO;
+			break;
+		}
+	}
+	fclose(i);
+	return ret;
+}
+
+/*
+ * the jobs of test_pool and the raw and compressed streams they check
+ */
+#define POOL_JOBS 16
+
+struct pool_test {
+	const struct buf *in;
+	const struct buf *z;
+	_Atomic size_t done;
+	_Atomic int ret;
+};
+
+/*
+ * check the output of the job j against the other stream of its test
+ */
+static void pool_done(struct lzpi_job *j)
+{
+	struct pool_test *t = j->arg;
+	const struct buf *w = j->decompress ? t->in : t->z;
+
+	if (!t->ret && (j->s.err || j->s.len != w->n ||
+			memcmp(j->s.out, w->bf, w->n)))
+		t->ret = j->s.err ? j->s.err : EILSEQ;
+	free(j->s.out);
+	++t->done;
+}
+
+/*
+ * set up the k-th job j of the test t, compressing in if k is even or else
+ * decompressing z
+ */
+static int pool_job(struct lzpi_job *j, size_t k, struct pool_test *t)
+{
+	const struct buf *s = k & 1 ? t->z : t->in;
+	const size_t cap = k & 1 ? t->in->n : t->in->n + t->in->n / 8 + 1;
+
+	*j = (struct lzpi_job){
+		{ s->bf, s->n, malloc(cap ? cap : 1), cap, 0, 0 },
+		(int)(k & 1),
+		NULL,
+		t,
+		NULL
+	};
+	return j->s.out ? 0 : ENOMEM;
+}
+
+/*
+ * wait for the pool to finish a job and reap every one finished
+ */
+static void pool_wait(void)
+{
+	struct pollfd p = { lzpi_pool_fd(), POLLIN, 0 };
+
+	while (!lzpi_reap())
+		poll(&p, 1, -1);
+}
+
+/*
+ * compress in and decompress z on a pool of 2 threads deeper than it holds
+ * jobs, resubmitting those refused with EAGAIN once a job is reaped, and
+ * check every output against z and in
+ */
+static int test_pool(const struct buf *in, const struct buf *z)
+{
+	struct lzpi_job j[POOL_JOBS];
+	struct pool_test t = { in, z, 0, 0 };
+	int ret;
+
+	if ((ret = lzpi_pool_start(2, POOL_JOBS / 4)))
+		return ret;
+	for (size_t k = 0; k != POOL_JOBS; ++k) {
+		if ((ret = pool_job(&j[k], k, &t)))
+			break;
+		while ((ret = lzpi_submit(&j[k], pool_done)) == EAGAIN)
+			pool_wait();
+		if (ret) {
+			free(j[k].s.out);
+			break;
+		}
+	}
+	/* stopping reaps every job still in flight */
+	lzpi_pool_stop();
+	if (!ret && t.done != POOL_JOBS)
+		ret = ECANCELED;
+	return ret ? ret : t.ret;
+}
+
+/*
+ * the jobs j of test_pool_stop, the k of them submitted so far, the error
+ * that ended their submission and whether it has ended
+ */
+struct pool_race {
+	struct lzpi_job *j;
+	size_t k;
+	int ret;
+	_Atomic int end;
+};
+
+/*
+ * submit every job of the race r, retrying those refused while the pool is
+ * full or stopping
+ */
+static void *race_submit(void *a)
+{
+	struct pool_race *r = a;
+
+	for (; r->k != POOL_JOBS; ++r->k) {
+		while ((r->ret = lzpi_submit(&r->j[r->k], pool_done)) ==
+			       EAGAIN ||
+		       r->ret == ESHUTDOWN)
+			if (!lzpi_reap())
+				sched_yield();
+		if (r->ret)
+			break;
+	}
+	r->end = 1;
+	return NULL;
+}
+
+/*
+ * stop the pool over and over until the submission of the race r ends
+ */
+static void *race_stop(void *a)
+{
+	struct pool_race *r = a;
+
+	while (!r->end) {
+		lzpi_pool_stop();
+		sched_yield();
+	}
+	return NULL;
+}
+
+/*
+ * submit the jobs of test_pool on one thread while two others stop the
+ * pool over and over, and check that every job is finished rather than
+ * lost to a pool that stopped under it
+ */
+static int test_pool_stop(const struct buf *in, const struct buf *z)
+{
+	struct lzpi_job j[POOL_JOBS];
+	struct pool_test t = { in, z, 0, 0 };
+	struct pool_race r = { j, 0, 0, 0 };
+	pthread_t th[2];
+	int ret, up;
+
+	for (size_t k = 0; k != POOL_JOBS; ++k)
+		if ((ret = pool_job(&j[k], k, &t))) {
+			while (k--)
+				free(j[k].s.out);
+			return ret;
+		}
+	if ((ret = lzpi_pool_start(2, POOL_JOBS / 4)) ||
+	    (ret = pthread_create(&th[0], NULL, race_submit, &r))) {
+		for (size_t k = 0; k != POOL_JOBS; ++k)
+			free(j[k].s.out);
+		lzpi_pool_stop();
+		return ret;
+	}
+	up = !(ret = pthread_create(&th[1], NULL, race_stop, &r));
+	race_stop(&r);
+	pthread_join(th[0], NULL);
+	if (up)
+		pthread_join(th[1], NULL);
+
+	/* stopping reaps the jobs of a pool the last submissions restarted */
+	lzpi_pool_stop();
+	for (size_t k = r.k; k != POOL_JOBS; ++k)
+		free(j[k].s.out);
+	if (!ret)
+		ret = r.ret;
+	if (!ret && t.done != r.k)
+		ret = ECANCELED;
+	return ret ? ret : t.ret;
+}
+
+/*
+ * the most buffers test_iovec splits a stream into
+ */
+#define IOVEC_MAX 4096
+
+/*
+ * split bf[0:n] into at most IOVEC_MAX buffers v of uneven lengths, from a
+ * byte up to beyond the window, and return how many there are
+ */
+static size_t split(uint8_t *bf, size_t n, struct iovec *v)
+{
+	static const size_t len[] = { 1, 255, 7, 4096, 256, 3, 65537, 2 };
+	size_t k = 0;
+
+	for (size_t p = 0; p != n; ++k) {
+		size_t l = len[k % (sizeof len / sizeof *len)];
+
+		if (k == IOVEC_MAX - 1 || l > n - p)
+			l = n - p;
+		v[k] = (struct iovec){ bf + p, l };
+		p += l;
+	}
+	return k;
+}
+
+/*
+ * compress in and decompress z spread over uneven buffers into uneven
+ * buffers, checking the output against z and in, and that an output a byte
+ * short fails with ENOBUFS
+ */
+static int test_iovec(const struct buf *in, const struct buf *z)
+{
+	static struct iovec i[IOVEC_MAX], o[IOVEC_MAX];
+	const size_t cap = in->n + in->n / 8 + 1;
+	uint8_t *out = malloc(cap);
+	size_t ni, no, len;
+	int ret;
+
+	if (!out)
+		return ENOMEM;
+	ni = split(in->bf, in->n, i);
+	no = split(out, cap, o);
+	if ((ret = lzpi_compressv(i, ni, o, no, &len)))
+		goto out;
+	if (len != z->n || memcmp(out, z->bf, z->n)) {
+		ret = EILSEQ;
+		goto out;
+	}
+
+	ni = split(z->bf, z->n, i);
+	no = split(out, in->n, o);
+	if ((ret = lzpi_decompressv(i, ni, o, no, &len)))
+		goto out;
+	if (len != in->n || memcmp(out, in->bf, in->n)) {
+		ret = EILSEQ;
+		goto out;
+	}
+
+	if (in->n && (no = split(out, in->n - 1, o),
+		      lzpi_decompressv(i, ni, o, no, &len) != ENOBUFS))
+		ret = EILSEQ;
+out:
+	free(out);
+	return ret;
+}
+
+/*
+ * the header of a sized stream, "LZPS" flag length, and its footer, length
+ */
+#define SIZED_HEADER 13
+#define SIZED_FOOTER 8
+
+/*
+ * wrap z as a sized stream of raw length l, with the length in the header
+ * or after the stream if tail is set, open it with lzpi_sized_open and
+ * decode it into out[0:cap], storing the length of the output in *len
+ */
+static int sized_open(const struct buf *z, uint64_t l, int tail,
+		      uint8_t *out, size_t cap, size_t *len)
+{
+	uint8_t *w = malloc(SIZED_HEADER + z->n + SIZED_FOOTER);
+	struct lzpi_stream s;
+	int ret;
+
+	if (!w)
+		return ENOMEM;
+	memcpy(w, "LZPS", 4);
+	w[4] = (uint8_t)tail;
+	for (unsigned k = 0; k != 8; ++k) {
+		w[5 + k] = tail ? 0 : (uint8_t)(l >> k * 8);
+		w[SIZED_HEADER + z->n + k] = (uint8_t)(l >> k * 8);
+	}
+	memcpy(w + SIZED_HEADER, z->bf, z->n);
+	ret = lzpi_sized_open(w, SIZED_HEADER + z->n + SIZED_FOOTER * !!tail,
+			      &s);
+	if (!ret && s.cap > cap)
+		ret = ENOBUFS;
+	if (!ret) {
+		s.out = out;
+		ret = lzpi_decompress_batch(&s, 1);
+		*len = s.len;
+	}
+	free(w);
+	return ret;
+}
+
+/*
+ * open z as a sized stream of the length of in, both with the length in the
+ * header and after the stream, checking the output against in, and check
+ * that one of a forged length beyond what z can decode to fails with EILSEQ
+ */
+static int test_sized(const struct buf *in, const struct buf *z)
+{
+	uint8_t *out = malloc(in->n + 1);
+	size_t len;
+	int ret = 0;
+
+	if (!out)
+		return ENOMEM;
+	for (int tail = 0; tail != 2 && !ret; ++tail)
+		if (!(ret = sized_open(z, in->n, tail, out, in->n, &len)) &&
+		    (len != in->n || memcmp(out, in->bf, in->n)))
+			ret = EILSEQ;
+	if (!ret && sized_open(z, (uint64_t)1 << 40, 0, out, in->n, &len) !=
+			    EILSEQ)
+		ret = EINVAL;
+	free(out);
+	return ret;
+}
+
+/*
+ * test [input] [output of lzpi for input]
+ * runs every test of the library, naming the first that fails
+ * returns errno on error
+ */
+int main(int argc, char **argv)
+{
+	struct buf in, z;
+	int ret;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage:\t\t%s input input.lzpi\n", argv[0]);
+		return 1;
+	}
+	if ((ret = load(argv[1], &in)) || (ret = load(argv[2], &z))) {
+		errno = ret;
+		perror(argv[0]);
+		return ret;
+	}
+
+	if ((ret = test_pool(&in, &z))) {
+		errno = ret;
+		perror("pool");
+	} else if ((ret = test_pool_stop(&in, &z))) {
+		errno = ret;
+		perror("pool stop");
+	} else if ((ret = test_iovec(&in, &z))) {
+		errno = ret;
+		perror("iovec");
+	} else if ((ret = test_sized(&in, &z))) {
+		errno = ret;
+		perror("sized");
+	}
+	free(z.bf);
+	free(in.bf);
+	return ret;
+}
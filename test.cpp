@@ -0,0 +1,317 @@
+/*
+ * Copyright 2024 Benjamin Byholm
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * the tests of lzpi.hpp, run by make test as c++17 and c++20 against lzpi.c
+ * built with -DLZPI_NO_MAIN
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#include "lzpi.hpp"
+
+namespace
+{
+
+/*
+ * all of file f
+ */
+std::string load(const char *f)
+{
+	std::ifstream i(f, std::ios::binary);
+
+	if (!i.is_open())
+		lzpi::fail(ENOENT);
+	return { std::istreambuf_iterator<char>(i),
+		 std::istreambuf_iterator<char>() };
+}
+
+/*
+ * the uneven lengths the tests split a stream into, from a byte up to more
+ * than a block
+ */
+constexpr std::size_t lengths[] = { 1, 255, 7, 4096, 256, 3, 65537, 2 };
+
+/*
+ * compress in through ocompressbuf in writes of uneven lengths, checking
+ * the output against z, and decompress z through idecompressbuf in reads
+ * of uneven lengths, checking the output against in
+ */
+void test_streambuf(const std::string &in, const std::string &z)
+{
+	std::stringbuf c;
+	std::string d;
+
+	{
+		lzpi::ocompressbuf o(&c);
+
+		for (std::size_t p = 0, k = 0; p != in.size(); ++k) {
+			const std::size_t l =
+				std::min(lengths[k % std::size(lengths)],
+					 in.size() - p);
+
+			if (o.sputn(in.data() + p,
+				    static_cast<std::streamsize>(l)) !=
+			    static_cast<std::streamsize>(l))
+				lzpi::fail(EIO);
+			p += l;
+		}
+		if (!o.finish())
+			lzpi::fail(EIO);
+	}
+	if (c.str() != z)
+		lzpi::fail(EILSEQ);
+
+	std::stringbuf s(z);
+	lzpi::idecompressbuf i(&s);
+
+	for (std::size_t k = 0;; ++k) {
+		std::string b(lengths[k % std::size(lengths)], '\0');
+		const std::streamsize l =
+			i.sgetn(b.data(), static_cast<std::streamsize>(b.size()));
+
+		d.append(b.data(), static_cast<std::size_t>(l));
+		if (l != static_cast<std::streamsize>(b.size()))
+			break;
+	}
+	if (d != in)
+		lzpi::fail(EILSEQ);
+}
+
+#ifdef __cpp_lib_span
+
+/*
+ * the bytes of s
+ */
+std::span<const std::byte> bytes(const std::string &s)
+{
+	return std::as_bytes(std::span(s.data(), s.size()));
+}
+
+/*
+ * compress in and decompress z through the helpers on spans, checking the
+ * output against z and in, and that an output a byte short fails with
+ * ENOBUFS
+ */
+void test_span(const std::string &in, const std::string &z)
+{
+	const auto c = lzpi::compress(bytes(in));
+	const auto d = lzpi::decompress(bytes(z));
+	std::vector<std::byte> o(in.size());
+
+	if (!std::equal(c.begin(), c.end(), bytes(z).begin(), bytes(z).end()) ||
+	    !std::equal(d.begin(), d.end(), bytes(in).begin(), bytes(in).end()))
+		lzpi::fail(EILSEQ);
+	if (lzpi::decompress(bytes(z), o) != in.size() ||
+	    !std::equal(o.begin(), o.end(), bytes(in).begin()))
+		lzpi::fail(EILSEQ);
+	if (!in.empty()) {
+		o.pop_back();
+		try {
+			lzpi::decompress(bytes(z), o);
+		} catch (const std::system_error &e) {
+			if (e.code().value() == ENOBUFS)
+				return;
+			throw;
+		}
+		lzpi::fail(EILSEQ);
+	}
+}
+
+#if __cpp_nontype_template_args >= 201911L
+
+/*
+ * an asset of n bytes mixing text, runs of zeros, a periodic pattern and
+ * noise, so the compressor at compile time takes every kind of token
+ */
+template <std::size_t N> constexpr std::array<std::uint8_t, N> asset()
+{
+	constexpr char text[] = "lzpi compresses at compile time, ";
+	std::array<std::uint8_t, N> a{};
+	std::uint32_t x = 1;
+
+	for (std::size_t k = 0; k != N; ++k) {
+		x = x * 1664525 + 1013904223;
+		switch (k / 256 % 4) {
+		case 0:
+			a[k] = static_cast<std::uint8_t>(
+				text[k % (sizeof text - 1)]);
+			break;
+		case 1:
+			a[k] = 0;
+			break;
+		case 2:
+			a[k] = static_cast<std::uint8_t>(k % 7 * 31);
+			break;
+		default:
+			a[k] = static_cast<std::uint8_t>(x >> 24);
+		}
+	}
+	return a;
+}
+
+constexpr auto small = asset<1>();
+constexpr auto large = asset<3000>();
+
+/*
+ * check compress<D> against the compressor at run time and unpack<D>
+ * against D
+ */
+template <auto D> void check_asset()
+{
+	constexpr auto c = lzpi::compress<D>();
+	const auto r = lzpi::compress(std::as_bytes(std::span(D)));
+
+	if (!std::equal(r.begin(), r.end(), std::as_bytes(std::span(c)).begin(),
+			std::as_bytes(std::span(c)).end()) ||
+	    lzpi::unpack<D>() != D)
+		lzpi::fail(EILSEQ);
+}
+
+/*
+ * check compress<D> and unpack<D> on assets of a byte and some KiB
+ */
+void test_constexpr(const std::string &, const std::string &)
+{
+	check_asset<small>();
+	check_asset<large>();
+}
+
+#endif
+
+#if __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+
+/*
+ * the bytes of s as chunks of uneven lengths
+ */
+std::vector<std::span<const std::byte>> split(const std::string &s)
+{
+	std::vector<std::span<const std::byte>> v;
+
+	for (std::size_t p = 0, k = 0; p != s.size(); ++k) {
+		const std::size_t l =
+			std::min(lengths[k % std::size(lengths)], s.size() - p);
+
+		v.push_back(bytes(s).subspan(p, l));
+		p += l;
+	}
+	return v;
+}
+
+/*
+ * the chunks of g joined
+ */
+std::string join(lzpi::generator<std::span<const std::byte>> g)
+{
+	std::string s;
+
+	for (std::span<const std::byte> c : g)
+		s.append(reinterpret_cast<const char *>(c.data()), c.size());
+	return s;
+}
+
+/*
+ * compress in from uneven chunks with encode_chunks, checking the output
+ * against z, decompress that generator with decode_chunks in small blocks,
+ * checking the output against in, and check that decode_chunks throws EIO
+ * on a stream cut within its last match
+ */
+void test_generator(const std::string &in, const std::string &z)
+{
+	const auto t = lzpi::compress(bytes(std::string(64, 'a')));
+
+	if (join(lzpi::encode_chunks(split(in))) != z ||
+	    join(lzpi::decode_chunks(lzpi::encode_chunks(split(in)), 1000)) !=
+		    in ||
+	    join(lzpi::decode_chunks(split(z))) != in)
+		lzpi::fail(EILSEQ);
+	try {
+		join(lzpi::decode_chunks(std::span(t).first(t.size() - 1)));
+	} catch (const std::system_error &e) {
+		if (e.code().value() == EIO)
+			return;
+		throw;
+	}
+	lzpi::fail(EILSEQ);
+}
+
+#endif
+
+#endif
+
+/*
+ * run the test t on in and z, reporting a failure as name
+ */
+template <class T>
+bool run(const char *name, T t, const std::string &in, const std::string &z)
+{
+	try {
+		t(in, z);
+		return true;
+	} catch (const std::exception &e) {
+		std::cerr << name << ": " << e.what() << '\n';
+		return false;
+	}
+}
+
+} // namespace
+
+/*
+ * test [input] [output of lzpi for input]
+ * runs every test of lzpi.hpp the standard provides for, naming those that
+ * fail
+ * returns 1 on failure
+ */
+int main(int argc, char **argv)
+{
+	std::string in, z;
+	bool ok = true;
+
+	if (argc != 3) {
+		std::cerr << "Usage:\t\t" << argv[0] << " input input.lzpi\n";
+		return 1;
+	}
+	try {
+		in = load(argv[1]);
+		z = load(argv[2]);
+	} catch (const std::exception &e) {
+		std::cerr << argv[0] << ": " << e.what() << '\n';
+		return 1;
+	}
+
+	ok &= run("streambuf", test_streambuf, in, z);
+#ifdef __cpp_lib_span
+	ok &= run("span", test_span, in, z);
+#if __cpp_nontype_template_args >= 201911L
+	ok &= run("constexpr", test_constexpr, in, z);
+#endif
+#if __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+	ok &= run("generator", test_generator, in, z);
+#endif
+#endif
+	return !ok;
+}
@@ -0,0 +1,78 @@
+"""Smoke test of the lzpi module, run by make python after building it."""
+
+import errno
+import random
+import unittest
+
+import lzpi
+
+
+def sample():
+    """A deterministic mix of text, zero runs and noise."""
+    r = random.Random(1)
+    parts = []
+    for k in range(64):
+        parts.append(b"lzpi compresses Raspberry Pi EEPROM images. " * (k % 5))
+        parts.append(bytes(k * 17 % 300))
+        parts.append(bytes(r.getrandbits(8) for _ in range(k * 13 % 200)))
+    return b"".join(parts)
+
+
+def chunks(data, lengths=(1, 255, 7, 4096, 256, 3, 65537, 2)):
+    """data split into parts of uneven lengths."""
+    p = k = 0
+    while p < len(data):
+        n = lengths[k % len(lengths)]
+        yield data[p : p + n]
+        p += n
+        k += 1
+
+
+class Test(unittest.TestCase):
+    def setUp(self):
+        self.data = sample()
+        self.z = lzpi.compress(self.data)
+
+    def test_round_trip(self):
+        self.assertLess(len(self.z), len(self.data))
+        self.assertEqual(lzpi.decompress(self.z), self.data)
+        self.assertEqual(lzpi.decompress(lzpi.compress(b"")), b"")
+        self.assertEqual(lzpi.decompress(memoryview(bytearray(self.z))), self.data)
+
+    def test_truncated(self):
+        z = lzpi.compress(b"a" * 64)
+        with self.assertRaises(OSError) as e:
+            lzpi.decompress(z[:-1])
+        self.assertEqual(e.exception.errno, errno.EIO)
+
+    def test_into(self):
+        out = bytearray(len(self.z) + 8)
+        n = lzpi.compress_into(self.data, out)
+        self.assertEqual(bytes(out[:n]), self.z)
+        out = bytearray(len(self.data))
+        self.assertEqual(lzpi.decompress_into(self.z, memoryview(out)), len(out))
+        self.assertEqual(bytes(out), self.data)
+
+    def test_into_too_small(self):
+        for f, data, n in (
+            (lzpi.compress_into, self.data, len(self.z) - 1),
+            (lzpi.decompress_into, self.z, len(self.data) - 1),
+        ):
+            with self.assertRaises(OSError) as e:
+                f(data, bytearray(n))
+            self.assertEqual(e.exception.errno, errno.ENOBUFS)
+
+    def test_chunked(self):
+        c = lzpi.Compressor()
+        z = b"".join(c.compress(p) for p in chunks(self.data)) + c.flush()
+        self.assertEqual(z, self.z)
+        d = lzpi.Decompressor()
+        self.assertEqual(b"".join(d.decompress(p) for p in chunks(z)), self.data)
+        self.assertTrue(d.done)
+        d = lzpi.Decompressor()
+        d.decompress(lzpi.compress(b"a" * 64)[:-1])
+        self.assertFalse(d.done)
+
+
+if __name__ == "__main__":
+    unittest.main()